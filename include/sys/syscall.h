@@ -3,13 +3,16 @@
 
 #include "types/syscallid.h"
 #include "types/pid.h"
+#include "types/meminfo.h"
+#include "types/priority.h"
+#include "types/fileflags.h"
 
 #ifdef __cplusplus
 extern "C"
 {
 #endif
 
-    int do_syscall(long id, unsigned long arg1, unsigned long arg2, unsigned long arg3, unsigned long arg4);
+    long do_syscall(long id, unsigned long arg1, unsigned long arg2, unsigned long arg3, unsigned long arg4);
 
     /**
      * @brief Prints `str` on the kernel log.
@@ -22,8 +25,9 @@ extern "C"
     }
 
     /**
-     * @brief Map a region in memory to newly allocated page frames
-     * @param ptr Pointer to the start of the region to map
+     * @brief Reserve a region of zero-filled memory. Page frames are only
+     * allocated when each page is first written.
+     * @param ptr Pointer to the start of the region to map (page-aligned)
      * @param size Size in bytes of the region to map
      * @param flags Access flags for the pages to map
      * @return
@@ -37,7 +41,8 @@ extern "C"
      * @brief Free the memory in a particular region
      * @param ptr Pointer to the start of the region to unmap
      * @param size Size in bytes of the region to unmap
-     * @return
+     * @return ENONE, EINVAL if the region is misaligned, empty or outside
+     * user memory, or ENOMEM if no memory was available to split a mapping
      */
     static inline int munmap(void *ptr, unsigned long size)
     {
@@ -182,11 +187,15 @@ extern "C"
     }
 
     /**
-     * @brief
+     * @brief Read up to `size` bytes from an open file. Reading a pipe or
+     * the UART waits until data arrives, unless the descriptor has
+     * FILE_NONBLOCK set.
      * @param fd
      * @param buffer
      * @param size
-     * @return
+     * @return the number of bytes read, EEOF at the end of a pipe, EAGAIN if
+     * nothing is available on a non-blocking descriptor, or another
+     * negative error code
      */
     static inline int read(int fd, void *buffer, unsigned long size)
     {
@@ -194,11 +203,14 @@ extern "C"
     }
 
     /**
-     * @brief
+     * @brief Write up to `size` bytes to an open file. Writing a full pipe
+     * waits until there is room, unless the descriptor has FILE_NONBLOCK
+     * set.
      * @param fd
      * @param buffer
      * @param size
-     * @return
+     * @return the number of bytes written, EAGAIN if a non-blocking pipe is
+     * full, or another negative error code
      */
     static inline int write(int fd, const void *buffer, unsigned long size)
     {
@@ -215,6 +227,111 @@ extern "C"
         return do_syscall(SYS_CREATE_PIPE, (unsigned long)pipefd, 0, 0, 0);
     }
 
+    /**
+     * @brief Create a new process with a copy-on-write duplicate of the current
+     * process's address space. Both processes resume after the call.
+     * @return the new process's pid in the parent, 0 in the child, or a
+     * negative error code
+     */
+    static inline int fork()
+    {
+        return do_syscall(SYS_FORK, 0, 0, 0, 0);
+    }
+
+    /**
+     * @brief Create a zero-filled shared memory segment.
+     * @param size Size in bytes of the segment
+     * @return a file descriptor referring to the segment, or a negative error
+     * code
+     */
+    static inline int shm_create(unsigned long size)
+    {
+        return do_syscall(SYS_SHM_CREATE, size, 0, 0, 0);
+    }
+
+    /**
+     * @brief Map a shared memory segment into this process. Writes through
+     * one mapping are visible through every other mapping of the segment.
+     * @param fd Descriptor returned by `shm_create`
+     * @param ptr Page-aligned address to map the segment at
+     * @param flags Access flags for the mapped pages
+     * @return
+     */
+    static inline int shm_map(int fd, void *ptr, int flags)
+    {
+        return do_syscall(SYS_SHM_MAP, (unsigned long)fd, (unsigned long)ptr, (unsigned long)flags, 0);
+    }
+
+    /**
+     * @brief Get a snapshot of memory usage: free physical memory, broken
+     * down by block size, kernel heap usage, and the resident pages of a
+     * process.
+     * @param pid Process whose resident pages to count, or 0 for this process
+     * @param info Structure to fill in
+     * @return
+     */
+    static inline int meminfo(pid_t pid, meminfo_t *info)
+    {
+        return do_syscall(SYS_MEMINFO, (unsigned long)pid, (unsigned long)info, 0, 0);
+    }
+
+    /**
+     * @brief Map part of an open file into this process at an address chosen
+     * by the kernel. Read-only mappings of ramfs files share the file
+     * system's own memory where its layout allows, so nothing is copied.
+     * The mapping is removed with `munmap`.
+     * @param fd Descriptor of the file to map
+     * @param offset Page-aligned offset into the file of the first byte to map
+     * @param size Number of bytes to map. Pages past the end of the file
+     * read as zero.
+     * @param flags Access flags for the mapped pages. Writable mappings are
+     * private copies; writes never reach the file.
+     * @return the address of the mapping, or a negative error code
+     */
+    static inline long mmap_file(int fd, unsigned long offset, unsigned long size, int flags)
+    {
+        return do_syscall(SYS_MMAP_FILE, (unsigned long)fd, offset, size, (unsigned long)flags);
+    }
+
+    /**
+     * @brief Change the scheduling priority of a process. Ready processes of
+     * a higher priority always run before those of a lower one, so
+     * latency-sensitive work (such as reading input) should be given a
+     * priority above batch work.
+     * @param pid Process to change, or 0 for the calling process
+     * @param priority New priority, from PRIORITY_MIN to PRIORITY_MAX.
+     * Processes start with the priority of their parent.
+     * @return 0 upon success, or a negative error code
+     */
+    static inline int setpriority(pid_t pid, int priority)
+    {
+        return do_syscall(SYS_SETPRIORITY, (unsigned long)pid, (unsigned long)priority, 0, 0);
+    }
+
+    /**
+     * @brief Suspend the calling process for at least `nanoseconds`. Sleeps
+     * have microsecond resolution and may overshoot by a few tens of
+     * microseconds.
+     * @param nanoseconds Time to sleep for
+     * @return 0 upon success, EINTR if a signal cut the sleep short, or a
+     * negative error code
+     */
+    static inline int nanosleep(unsigned long nanoseconds)
+    {
+        return do_syscall(SYS_NANOSLEEP, nanoseconds, 0, 0, 0);
+    }
+
+    /**
+     * @brief Set the flags of an open file, such as FILE_NONBLOCK.
+     * @param fd File descriptor to change
+     * @param flags Flags from `file_flags_t`
+     * @return 0 upon success, or a negative error code
+     */
+    static inline int setflags(int fd, int flags)
+    {
+        return do_syscall(SYS_SETFLAGS, (unsigned long)fd, (unsigned long)flags, 0, 0);
+    }
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,22 @@
+#ifndef KERNEL_FILEFLAGS_H
+#define KERNEL_FILEFLAGS_H
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    enum file_flags_t
+    {
+        /**
+         * @brief Reads and writes that cannot make progress return EAGAIN
+         * instead of waiting
+         */
+        FILE_NONBLOCK = 1
+    };
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef KERNEL_MEMINFO_H
+#define KERNEL_MEMINFO_H
+
+/**
+ * @brief Number of block sizes reported in `meminfo_t::free_blocks`.
+ */
+#define MEMINFO_ORDERS 32
+
+/**
+ * @brief Snapshot of memory usage, filled in by the `meminfo` syscall. Page
+ * counts are in units of the system page size.
+ */
+typedef struct meminfo_t
+{
+    /**
+     * @brief Pages managed by the page allocator
+     */
+    unsigned long total_pages;
+
+    /**
+     * @brief Pages not currently reserved
+     */
+    unsigned long free_pages;
+
+    /**
+     * @brief Reserved pages held cleared, ready for new mappings
+     */
+    unsigned long zeroed_pages;
+
+    /**
+     * @brief Number of free blocks of 2^n pages, for each order n
+     */
+    unsigned long free_blocks[MEMINFO_ORDERS];
+
+    /**
+     * @brief Bytes in allocated kernel heap blocks, including tags
+     */
+    unsigned long heap_used;
+
+    /**
+     * @brief Bytes in free kernel heap blocks
+     */
+    unsigned long heap_free;
+
+    /**
+     * @brief Size in bytes of the largest free kernel heap block
+     */
+    unsigned long heap_largest_free;
+
+    /**
+     * @brief Pages backed by a frame in the process's address space
+     */
+    unsigned long resident_pages;
+
+    /**
+     * @brief Resident pages whose frames are also mapped elsewhere
+     */
+    unsigned long shared_pages;
+} meminfo_t;
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef KERNEL_PRIORITY_H
+#define KERNEL_PRIORITY_H
+
+/**
+ * @brief Lowest scheduling priority. Processes at a higher priority always
+ * run first; processes at the same priority take turns.
+ */
+#define PRIORITY_MIN 0
+
+/**
+ * @brief Highest scheduling priority
+ */
+#define PRIORITY_MAX 31
+
+/**
+ * @brief Priority of the first process. Other processes inherit the
+ * priority of the process that created them.
+ */
+#define PRIORITY_DEFAULT 16
+
+#endif
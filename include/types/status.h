@@ -18,7 +18,9 @@ extern "C"
         EIO = -7,
         EEXISTS = -8,
         EPIPE = -9,
-        EFULL = -10
+        EFULL = -10,
+        EAGAIN = -11,
+        EINTR = -12
     };
 
 #ifdef __cplusplus
@@ -26,7 +26,15 @@ extern "C"
         SYS_READ,
         SYS_WRITE,
         SYS_FDDUP,
-        SYS_CREATE_PIPE
+        SYS_CREATE_PIPE,
+        SYS_FORK,
+        SYS_SHM_CREATE,
+        SYS_SHM_MAP,
+        SYS_MEMINFO,
+        SYS_MMAP_FILE,
+        SYS_SETPRIORITY,
+        SYS_NANOSLEEP,
+        SYS_SETFLAGS
     } syscallid_t;
 
 #ifdef __cplusplus
@@ -5,16 +5,22 @@
 #include "util/string.h"
 #include "devices/uart.h"
 #include "devices/timer.h"
+#include "devices/coretimer.h"
+#include "devices/coremailbox.h"
+#include "devices/devicetree.h"
+#include "types/status.h"
 #include "util/log.h"
 #include "sched/context.h"
 #include "irq/interrupts.h"
 #include "loader/elf.h"
 #include "util/hacf.h"
 #include "sched/process.h"
+#include "sched/cpu.h"
 #include "kernel.h"
 #include "fs/fat32/fat32.h"
 #include "containers/binary_search_tree.h"
 #include "util/charstream.h"
+#include "util/membench.h"
 
 using namespace kernel::memory;
 using namespace kernel::devices;
@@ -23,10 +29,115 @@ using namespace kernel::interrupt;
 using namespace kernel::loader;
 using namespace kernel::fs;
 
+/**
+ * @brief Number of regions placed into the memory map by `aarch64_boot`
+ * besides those read from the device tree
+ */
+static const unsigned long bootRegionCount = 7;
+
+/**
+ * @brief Amount of physical memory reachable through the physical memory
+ * window. RAM above this is left unused.
+ */
+static const unsigned long physicalWindowSize = 1UL << 32;
+
+/**
+ * @brief Start of the spin table the firmware's secondary cores wait on.
+ * Core n jumps to the physical address stored at offset 8n once it is
+ * non-zero.
+ */
+static const unsigned long spinTableOffset = 0xD8;
+
+/**
+ * @brief Microseconds to wait for each secondary core to report in
+ */
+static const unsigned long secondaryStartTimeout = 100000;
+
+/**
+ * @brief Register values a secondary core starts with, filled in by the
+ * primary core. `_secondary_start` reads this with the MMU off, so the
+ * layout must match the offsets used there.
+ */
+struct SecondaryBootArgs
+{
+    unsigned long mair, tcr, ttbr, sctlr;
+
+    /**
+     * @brief Top of the core's stack; the core clears it once it no longer
+     * needs these values
+     */
+    void *stack;
+
+    void (*entry)(int cpu);
+};
+
+extern "C"
+{
+    volatile SecondaryBootArgs secondary_boot_args;
+}
+
 UART uart;
 
 SystemTimer timer;
 
+CoreTimer coreTimer;
+
+CoreMailbox coreMailbox;
+
+extern "C" void aarch64_secondary_boot(int cpu)
+{
+    Interrupts::initCpu();
+    coreTimer.initCpu();
+    coreMailbox.initCpu();
+
+    kernel::kernel.enterKernel(nullptr);
+    kernelLog(LogLevel::INFO, "CPU %i started", cpu);
+    kernel::kernel.switchTask();
+    load_context(kernel::kernel.leaveKernel());
+}
+
+/**
+ * @brief Releases each secondary core from the firmware's spin loop onto
+ * its idle stack, and waits for it to start. Cores then wait for the kernel
+ * to be unlocked.
+ */
+static void startSecondaryCpus()
+{
+    unsigned long entry, mair, tcr, ttbr, sctlr;
+    // _secondary_start is linked at its physical address, out of reach of
+    // PC-relative addressing from here
+    asm volatile("ldr %0, =_secondary_start" : "=r"(entry));
+    asm volatile("mrs %0, mair_el1" : "=r"(mair));
+    asm volatile("mrs %0, tcr_el1" : "=r"(tcr));
+    asm volatile("mrs %0, ttbr1_el1" : "=r"(ttbr));
+    asm volatile("mrs %0, sctlr_el1" : "=r"(sctlr));
+    secondary_boot_args.mair = mair;
+    secondary_boot_args.tcr = tcr;
+    secondary_boot_args.ttbr = ttbr;
+    secondary_boot_args.sctlr = sctlr;
+    secondary_boot_args.entry = aarch64_secondary_boot;
+
+    for (int cpu = 1; cpu < maxCpus; cpu++)
+    {
+        secondary_boot_args.stack = kernel::kernel.getIdleStack(cpu);
+        asm volatile("dsb sy" ::: "memory");
+        *(volatile unsigned long *)(&__high_mem + spinTableOffset + 8 * cpu) = entry;
+        asm volatile("dsb sy" ::: "memory");
+        asm volatile("sev");
+
+        unsigned long start = timer.now();
+        while (secondary_boot_args.stack != nullptr && timer.now() - start < secondaryStartTimeout)
+        {
+        }
+        if (secondary_boot_args.stack != nullptr)
+        {
+            // A late core would still find its own arguments, so stop here
+            kernelLog(LogLevel::WARNING, "CPU %i did not start", cpu);
+            return;
+        }
+    }
+}
+
 extern "C" void aarch64_boot(uint64_t dtb, uint64_t kernelSize)
 {
     Interrupts::init();
@@ -41,29 +152,92 @@ extern "C" void aarch64_boot(uint64_t dtb, uint64_t kernelSize)
     kernelLog(LogLevel::DEBUG, "DTB Location = %016x", dtb);
     kernelLog(LogLevel::DEBUG, "Kernel size = %i MiB", kernelSize >> 20);
 
-    MemoryMap map;
-    map.place(MemoryMap::MemoryType::AVAILABLE, 0, 0x20000000);
+    // The physical memory window is needed to read the device tree. At first
+    // it only covers the first GiB, which is where the bootloader puts the DTB.
+    void *physicalWindow = &__high_mem + 0x100000000;
+    setPageEntry(2, physicalWindow, 0, PAGE_RW);
+
+    DeviceTree deviceTree(dtb != 0 && dtb < (1UL << 30) ? physicalWindow + dtb : nullptr);
+
+    // The region array goes at the end of the kernel image, followed by the
+    // page allocator's block map.
+    unsigned long capacity = MemoryMap::capacityFor(deviceTree.countMemoryRegions() + bootRegionCount);
+    MemoryMap::MemoryRegion *regions = (MemoryMap::MemoryRegion *)&__end;
+    MemoryMap map(regions, capacity);
+    if (deviceTree.readMemoryMap(map) != ENONE || map.size() == 0)
+    {
+        kernelLog(LogLevel::WARNING, "No memory found in device tree, assuming 512 MiB of RAM");
+        map = MemoryMap(regions, capacity);
+        map.place(MemoryMap::MemoryType::AVAILABLE, 0, 0x20000000);
+    }
+
+    unsigned long ramEnd = 0;
+    for (int i = 0; i < map.size(); i++)
+    {
+        if (map[i].getType() == MemoryMap::MemoryType::AVAILABLE)
+        {
+            ramEnd = map[i].end();
+        }
+    }
+    kernelLog(LogLevel::INFO, "Found %i MiB of RAM", ramEnd >> 20);
+    for (unsigned long offset = 1UL << 30; offset < ramEnd && offset < physicalWindowSize; offset += 1UL << 30)
+    {
+        setPageEntry(2, physicalWindow + offset, offset, PAGE_RW);
+    }
+    if (ramEnd > physicalWindowSize)
+    {
+        kernelLog(LogLevel::WARNING, "Ignoring RAM beyond %i MiB", physicalWindowSize >> 20);
+        map.place(MemoryMap::MemoryType::UNAVAILABLE, physicalWindowSize, ramEnd - physicalWindowSize);
+    }
+
+    void *pageMap = (void *)(((unsigned long)(regions + capacity) + page_size - 1) & ~(page_size - 1));
     map.place(MemoryMap::MemoryType::MMIO, 0x3f000000, 0x1000000);
     map.place(MemoryMap::MemoryType::UNAVAILABLE, (unsigned long)0, kernelSize);
-    map.place(MemoryMap::MemoryType::UNAVAILABLE, (unsigned long)&__end - (unsigned long)&__high_mem, PageAllocator::mapSize(map, page_size));
+    if (deviceTree.isValid())
+    {
+        map.place(MemoryMap::MemoryType::UNAVAILABLE, dtb, deviceTree.size());
+    }
+    map.place(MemoryMap::MemoryType::UNAVAILABLE, (unsigned long)pageMap - (unsigned long)&__high_mem, PageAllocator::mapSize(map, page_size));
     map.place(MemoryMap::MemoryType::UNAVAILABLE, (unsigned long)0x8000000, 1 << 26);
-    kernel::kernel.initMemory(map, kernelSize);
+    if (kernel::kernel.initMemory(map, pageMap, kernelSize) != ENONE)
+    {
+        hacf();
+    }
+
+#ifdef MEMBENCH
+    membench();
+#endif
 
-    setPageEntry(2, &__high_mem + 0x100000000, 0, PAGE_RW);
     kernel::kernel.initRamFS((void *)(&__high_mem + 0x108000000));
 
-    new (&timer) SystemTimer(50);
+    new (&timer) SystemTimer();
     Interrupts::insertHandler(0, &timer);
     Interrupts::insertHandler(1, &timer);
     Interrupts::insertHandler(2, &timer);
     Interrupts::insertHandler(3, &timer);
+    kernel::kernel.setClock(&timer);
+
+    new (&coreTimer) CoreTimer();
+    new (&coreMailbox) CoreMailbox();
+    // find_irq_source() numbers core-local interrupts from 96
+    Interrupts::insertHandler(97, &coreTimer);
+    Interrupts::insertHandler(100, &coreMailbox);
+    coreTimer.initCpu();
+    coreMailbox.initCpu();
+    kernel::kernel.setCoreDevices(&coreTimer, &coreMailbox);
+    if (kernel::kernel.initIdleStacks() != ENONE)
+    {
+        kernelLog(LogLevel::PANIC, "Failed to allocate idle stacks");
+        hacf();
+    }
 
     char *const argv[] = {"/bin/init", nullptr};
     char *const envp[] = {"cwd=/", nullptr};
 
     kernelLog(LogLevel::DEBUG, "Creating first process.");
+    kernel::kernel.enterKernel(nullptr);
     Process *p = new Process();
-    kernel::kernel.addProcess(*p);
+    kernel::kernel.addProcess(p);
     kernel::kernel.switchTask();
     if (kernel::kernel.exec("/bin/init", argv, envp))
     {
@@ -71,8 +245,10 @@ extern "C" void aarch64_boot(uint64_t dtb, uint64_t kernelSize)
         hacf();
     }
 
+    startSecondaryCpus();
+
     kernelLog(LogLevel::INFO, "Bootup complete, loading first process...");
-    load_context(kernel::kernel.getActiveProcess()->getContext());
+    load_context(kernel::kernel.leaveKernel());
 
     while (1)
         asm("nop");
@@ -8,19 +8,10 @@ ttl2:
 .skip 4096
 
 .section ".boot.text"
- 
-// Entry point for the kernel. Registers:
-// x0 -> 32 bit pointer to DTB in memory (primary core only) / 0 (secondary cores)
-.globl _start
-_start:
 
-    // Check if we're already in EL1
-  /*ldr     x6, =_el1_prepare
-    bic     x6, x6, #0xFFFF << 48
-    mrs     x5, CurrentEL
-    cmp     x5, #8
-    blt     x6*/
-    
+// Configures EL1 and drops into it from EL2, continuing at \target with
+// all exceptions masked. Shared by the primary and secondary cores.
+.macro enter_el1 target
     // Disable IRQ routing to EL2, set EL1 execution mode to AArch64
     mrs     x5, HCR_EL2
     orr     x5, x5, #0x80000000
@@ -36,12 +27,14 @@ _start:
     orr     x5, x5, #3 << 20
     msr     CPACR_EL1, x5
 
-    // Set stack before our code
-    ldr     x5, =_start
-    msr     SP_EL1, x5
+    // Let EL1 use the physical counter and timer
+    mrs     x5, CNTHCTL_EL2
+    orr     x5, x5, #3
+    msr     CNTHCTL_EL2, x5
+    msr     CNTVOFF_EL2, xzr
 
-    // Point exception link register to _el1_begin
-    ldr     x5, =_el1_begin
+    // Point exception link register to \target
+    ldr     x5, =\target
     msr     ELR_EL2, x5
 
     // Modify saved program status register to mask exceptions and be in EL1
@@ -51,8 +44,27 @@ _start:
     orr     x5, x5, x6
     msr     SPSR_EL2, x5
 
-    // Fall into EL1, jump to _el1_begin
+    // Fall into EL1, jump to \target
     eret
+.endm
+ 
+// Entry point for the kernel. Registers:
+// x0 -> 32 bit pointer to DTB in memory (primary core only) / 0 (secondary cores)
+.globl _start
+_start:
+
+    // Check if we're already in EL1
+  /*ldr     x6, =_el1_prepare
+    bic     x6, x6, #0xFFFF << 48
+    mrs     x5, CurrentEL
+    cmp     x5, #8
+    blt     x6*/
+    
+    // Set stack before our code
+    ldr     x5, =_start
+    msr     SP_EL1, x5
+
+    enter_el1 _el1_begin
 _el1_prepare:
     ldr     x5, =_start
     mov     sp, x5
@@ -95,6 +107,50 @@ halt:
     wfe
     b       halt
 
+// Entry point for the secondary cores, released from the firmware's spin
+// loop by the primary core once the kernel is running. The primary core
+// leaves the register values to use in secondary_boot_args, which is read
+// through its physical address until the MMU is on:
+// [0] MAIR_EL1, [8] TCR_EL1, [16] TTBR1_EL1, [24] SCTLR_EL1,
+// [32] stack pointer, [40] entry point
+.globl _secondary_start
+_secondary_start:
+    enter_el1 _secondary_el1
+_secondary_el1:
+    ldr     x0, =bootstrap_vector_table_el1
+    msr     VBAR_EL1, x0
+
+    ldr     x1, =secondary_boot_args
+    ldr     x2, =__high_mem
+    sub     x1, x1, x2
+
+    // Use the primary core's translation tables for both halves, as the
+    // bootstrap does, so this code stays mapped once the MMU is on
+    ldp     x2, x3, [x1]
+    msr     MAIR_EL1, x2
+    msr     TCR_EL1, x3
+    ldr     x2, [x1, #16]
+    msr     TTBR0_EL1, x2
+    msr     TTBR1_EL1, x2
+    tlbi    vmalle1
+    dsb     ish
+    isb
+    ldr     x3, [x1, #24]
+    msr     SCTLR_EL1, x3
+    isb
+
+    ldp     x2, x3, [x1, #32]
+    mov     sp, x2
+
+    // Tell the primary core the arguments are no longer needed
+    str     xzr, [x1, #32]
+    dsb     sy
+
+    // Pass the core number to the entry point
+    mrs     x0, MPIDR_EL1
+    and     x0, x0, #3
+    br      x3
+
 .balign 0x800
 bootstrap_vector_table_el1:
     bootstrap__ex_el1_curr_sp0_sync:
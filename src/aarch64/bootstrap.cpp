@@ -241,6 +241,12 @@ extern "C" void mmu_init(uint64_t kernel_size, uint64_t *level0, uint64_t *level
     level2[504] = 0x3f000000 | 1025 | 4;
     level2[505] = 0x3f200000 | 1025 | 4;
 
+    /*
+     * Map the core-local peripherals at 0x40000000 (timer and mailbox
+     * interrupt routing) as device memory, right after the first GiB.
+     */
+    level1[1] = 0x40000000 | 1025 | 4;
+
     log("Filled kernel table entries.");
 
     /*
@@ -81,6 +81,7 @@ _not_syscall:
     mov x0, x8
     mov x1, x9
     mov x2, x5
+    mov x3, #0
     bl handle_sync
     
     // Load next process context returned from handle_sync
@@ -99,6 +100,12 @@ _sync_el1_wrapper:
     stp x16, x17, [sp, #-16]!
     stp x18, lr, [sp, #-16]!
 
+    // Save return state, as handling this fault may itself fault (e.g. when
+    // page tables need to be allocated)
+    mrs x0, elr_el1
+    mrs x1, spsr_el1
+    stp x0, x1, [sp, #-16]!
+
     // Unpack exception syndrome register
     mrs x0, esr_el1
     mov x1, x0
@@ -110,10 +117,18 @@ _sync_el1_wrapper:
 
     // Give handle_sync() a NULL-pointer as a process context, as we came from kernelspace
     mov x2, #0
+
+    // Let handle_sync() change the saved return address
+    mov x3, sp
     
     // Call handle_sync()
     bl handle_sync
 
+    // Restore return state
+    ldp x0, x1, [sp], #16
+    msr elr_el1, x0
+    msr spsr_el1, x1
+
     // Restore saved registers
     ldp x18, lr, [sp], #16
     ldp x16, x17, [sp], #16
@@ -3,10 +3,11 @@
 #include "aarch64/sysreg.h"
 #include "devices/mmio.h"
 
+extern "C" int find_irq_source();
+
 void kernel::interrupt::Interrupts::init()
 {
-    set_vbar_el1(&vector_table_el1);
-    disable();
+    initCpu();
     for (int i = 0; i < HANDLER_COUNT; i++)
     {
         handlers[i] = nullptr;
@@ -19,6 +20,12 @@ void kernel::interrupt::Interrupts::init()
     // mmio_write((void *)MMIOOffset::INTR_IRQ_DISABLE_2, 0xFF6800);
 }
 
+void kernel::interrupt::Interrupts::initCpu()
+{
+    set_vbar_el1(&vector_table_el1);
+    disable();
+}
+
 void kernel::interrupt::Interrupts::enable()
 {
     set_daif(0);
@@ -27,4 +34,11 @@ void kernel::interrupt::Interrupts::enable()
 void kernel::interrupt::Interrupts::disable()
 {
     set_daif(15 << 6);
-}
\ No newline at end of file
+}
+
+int kernel::interrupt::Interrupts::waitForInterrupt()
+{
+    // A pending interrupt ends wfi even while it is masked
+    asm volatile("wfi");
+    return find_irq_source();
+}
@@ -5,14 +5,39 @@
 #include "syndromedataabort.h"
 #include "devices/mmio.h"
 #include "sched/context.h"
+#include "sched/cpu.h"
 #include "../sysreg.h"
 #include "util/log.h"
 #include "kernel.h"
 
-void handlePageFault(ExceptionClass type, SyndromeDataAbort syndrome);
+void handlePageFault(ExceptionClass type, SyndromeDataAbort syndrome, unsigned long *returnAddress);
+
+/**
+ * @brief Interrupt id of bit 0 of a core's local interrupt source register.
+ * Local sources are numbered above the 64 GPU interrupts.
+ */
+static const int localIrqBase = 96;
+
+/**
+ * @brief Bit of a core's local interrupt source register set while a GPU
+ * interrupt is pending. GPU interrupts are only routed to core 0.
+ */
+static const unsigned int localGpuPending = 1 << 8;
 
 extern "C" int find_irq_source()
 {
+    // Core-local interrupts (generic timers and mailboxes) come first
+    uint64_t sourceRegister = (uint64_t)MMIOOffset::LOCAL_IRQ_SOURCE + 4 * kernel::sched::currentCpu();
+    unsigned int local = mmio_read((void *)sourceRegister);
+    if ((local & 0xFF) != 0)
+    {
+        return localIrqBase + __builtin_ctz(local & 0xFF);
+    }
+    else if ((local & localGpuPending) == 0)
+    {
+        return -1;
+    }
+
     unsigned int pending1 = mmio_read((void *)MMIOOffset::INTR_IRQ_PENDING_1);
     if (pending1 != 0)
     {
@@ -34,22 +59,29 @@ extern "C" int find_irq_source()
     return -1;
 }
 
-extern "C" kernel::sched::Context *handle_sync(ExceptionClass type, unsigned long syndrome, kernel::sched::Context *ctx)
+/**
+ * @param returnAddress the saved return address for exceptions taken from
+ * EL1, which may be changed to resume somewhere else; nullptr for EL0
+ */
+extern "C" kernel::sched::Context *handle_sync(ExceptionClass type, unsigned long syndrome, kernel::sched::Context *ctx, unsigned long *returnAddress)
 {
+    // Exceptions taken from EL1 happen inside the kernel, which is already
+    // locked
+    if (returnAddress == nullptr)
+    {
+        kernel::kernel.enterKernel(ctx);
+    }
+
     switch (type)
     {
-    case ExceptionClass::INST_ABORT_EL0:
-        kernelLog(LogLevel::PANIC, "Unhandled INST_ABORT_EL0, FAR_EL1 = %016x", get_far_el1());
-        hacf();
     case ExceptionClass::INST_ABORT_EL1:
         kernelLog(LogLevel::PANIC, "Unhandled INST_ABORT_EL1, FAR_EL1 = %016x", get_far_el1());
         hacf();
+    case ExceptionClass::INST_ABORT_EL0:
+        // Instruction fault status codes match the data abort ones, with WnR clear
     case ExceptionClass::DATA_ABORT_EL0:
-        kernelLog(LogLevel::PANIC, "Unhandled DATA_ABORT_EL0, FAR_EL1 = %016x", get_far_el1());
-        hacf();
-        break;
     case ExceptionClass::DATA_ABORT_EL1:
-        handlePageFault(type, *(SyndromeDataAbort *)&syndrome);
+        handlePageFault(type, *(SyndromeDataAbort *)&syndrome, returnAddress);
         break;
     case ExceptionClass::SVC_AARCH64:
     case ExceptionClass::SVC_AARCH32:
@@ -59,28 +91,30 @@ extern "C" kernel::sched::Context *handle_sync(ExceptionClass type, unsigned lon
         hacf();
         break;
     }
-    return ctx;
+    return returnAddress == nullptr ? kernel::kernel.leaveKernel() : ctx;
 }
 
 extern "C" kernel::sched::Context *handle_irq(int source, kernel::sched::Context *ctx)
 {
     using namespace kernel::interrupt;
-    if (kernel::kernel.getActiveProcess() != nullptr)
-    {
-        kernel::kernel.getActiveProcess()->storeContext(ctx);
-    }
-
     // kernelLog(LogLevel::DEBUG, "handle_irq(%i, %016x)", source, ctx);
 
-    if (source < 0)
+    if (ctx == nullptr)
     {
+        // Taken inside the kernel, which is already locked
+        if (source >= 0)
+        {
+            Interrupts::callHandler(source);
+        }
         return ctx;
     }
 
-    Interrupts::callHandler(source);
-    if (kernel::kernel.getActiveProcess() != nullptr)
+    kernel::kernel.enterKernel(ctx);
+    if (source >= 0)
     {
-        return kernel::kernel.getActiveProcess()->getContext();
+        Interrupts::callHandler(source);
+        // The handler may have woken a process or ended a timeslice
+        kernel::kernel.checkPreemption();
     }
-    return ctx;
+    return kernel::kernel.leaveKernel();
 }
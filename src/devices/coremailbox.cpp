@@ -0,0 +1,23 @@
+#include "coremailbox.h"
+#include "mmio.h"
+#include "sched/cpu.h"
+
+void kernel::devices::CoreMailbox::initCpu()
+{
+    int cpu = sched::currentCpu();
+    mmio_write((void *)((uint64_t)MMIOOffset::LOCAL_MAILBOX0_CLEAR + 16 * cpu), 0xFFFFFFFF);
+    mmio_write((void *)((uint64_t)MMIOOffset::LOCAL_MAILBOX_INT_CTRL + 4 * cpu), 1);
+}
+
+void kernel::devices::CoreMailbox::send(int cpu)
+{
+    // Make everything written so far visible before the other core wakes
+    asm volatile("dsb sy" ::: "memory");
+    mmio_write((void *)((uint64_t)MMIOOffset::LOCAL_MAILBOX0_SET + 16 * cpu), 1);
+}
+
+void kernel::devices::CoreMailbox::handleInterrupt(int src)
+{
+    int cpu = sched::currentCpu();
+    mmio_write((void *)((uint64_t)MMIOOffset::LOCAL_MAILBOX0_CLEAR + 16 * cpu), 0xFFFFFFFF);
+}
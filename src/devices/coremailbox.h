@@ -0,0 +1,37 @@
+#ifndef KERNEL_COREMAILBOX_H
+#define KERNEL_COREMAILBOX_H
+
+#include "irq/interrupthandler.h"
+
+namespace kernel::devices
+{
+
+    /**
+     * @brief Driver for the BCM2836 core mailboxes, used to interrupt
+     * another processor. Only mailbox 0 of each core is used, and the
+     * message itself carries no meaning: a processor that is interrupted
+     * this way simply re-examines its run queue and pending signals.
+     */
+    class CoreMailbox : public kernel::interrupt::InterruptHandler
+    {
+    public:
+        /**
+         * @brief Routes the calling processor's mailbox interrupt to it. Must
+         * be called once on each processor.
+         */
+        void initCpu();
+
+        /**
+         * @brief Interrupts processor `cpu`.
+         */
+        void send(int cpu);
+
+        /**
+         * @brief Clears the calling processor's mailbox.
+         */
+        void handleInterrupt(int src);
+    };
+
+}
+
+#endif
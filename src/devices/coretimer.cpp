@@ -0,0 +1,57 @@
+#include "coretimer.h"
+#include "mmio.h"
+
+/**
+ * @brief Bit enabling the non-secure physical timer interrupt in a core's
+ * timer interrupt control register
+ */
+static const unsigned int physicalTimerIrq = 1 << 1;
+
+kernel::devices::CoreTimer::CoreTimer()
+{
+    for (int i = 0; i < sched::maxCpus; i++)
+    {
+        armed[i] = false;
+    }
+}
+
+void kernel::devices::CoreTimer::initCpu()
+{
+    int cpu = sched::currentCpu();
+    disarm();
+    mmio_write((void *)((uint64_t)MMIOOffset::LOCAL_TIMER_INT_CTRL + 4 * cpu), physicalTimerIrq);
+}
+
+void kernel::devices::CoreTimer::arm(unsigned long microseconds)
+{
+    unsigned long frequency;
+    asm volatile("mrs %0, cntfrq_el0" : "=r"(frequency));
+    unsigned long ticks = microseconds * frequency / 1000000;
+    if (ticks > maxTicks)
+    {
+        ticks = maxTicks;
+    }
+    asm volatile("msr cntp_tval_el0, %0" ::"r"(ticks));
+    // Enable, with the interrupt unmasked
+    asm volatile("msr cntp_ctl_el0, %0" ::"r"(1UL));
+    asm volatile("isb");
+    armed[sched::currentCpu()] = true;
+}
+
+void kernel::devices::CoreTimer::disarm()
+{
+    // A disabled timer drops its interrupt
+    asm volatile("msr cntp_ctl_el0, %0" ::"r"(0UL));
+    asm volatile("isb");
+    armed[sched::currentCpu()] = false;
+}
+
+bool kernel::devices::CoreTimer::isArmed() const
+{
+    return armed[sched::currentCpu()];
+}
+
+void kernel::devices::CoreTimer::handleInterrupt(int src)
+{
+    disarm();
+}
@@ -0,0 +1,62 @@
+#ifndef KERNEL_CORETIMER_H
+#define KERNEL_CORETIMER_H
+
+#include "irq/interrupthandler.h"
+#include "sched/cpu.h"
+
+namespace kernel::devices
+{
+
+    /**
+     * @brief Driver for the ARM generic timers built into each core. Every
+     * core has its own timer, and its interrupt only reaches that core, so
+     * each processor can be interrupted at the end of its own timeslice.
+     * Every method acts on the timer of the calling processor.
+     */
+    class CoreTimer : public kernel::interrupt::InterruptHandler
+    {
+    public:
+        CoreTimer();
+
+        /**
+         * @brief Routes the calling processor's timer interrupt to it. Must
+         * be called once on each processor before it arms its timer.
+         */
+        void initCpu();
+
+        /**
+         * @brief Interrupts the calling processor once `microseconds` have
+         * passed, replacing any earlier request.
+         */
+        void arm(unsigned long microseconds);
+
+        /**
+         * @brief Cancels the calling processor's timer, if it is armed.
+         */
+        void disarm();
+
+        /**
+         * @return true while the calling processor's timer is armed
+         */
+        bool isArmed() const;
+
+        /**
+         * @brief Disarms the timer. There is nothing else to do: the
+         * interrupt itself makes handle_irq check whether the running
+         * process should give way.
+         */
+        void handleInterrupt(int src);
+
+    private:
+        /**
+         * @brief Longest delay programmed at once, as the timer value
+         * register is a signed 32-bit count of ticks
+         */
+        static const unsigned long maxTicks = 0x7FFFFFFF;
+
+        bool armed[sched::maxCpus];
+    };
+
+}
+
+#endif
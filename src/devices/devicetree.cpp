@@ -0,0 +1,309 @@
+#include "devicetree.h"
+#include "types/status.h"
+
+using namespace kernel::devices;
+using namespace kernel::memory;
+
+namespace
+{
+
+    const unsigned int fdtMagic = 0xd00dfeed;
+
+    /**
+     * @brief Oldest layout this parser understands; version 16 is the first
+     * to keep all strings out of the structure block.
+     */
+    const unsigned int fdtCompatVersion = 16;
+
+    enum Token
+    {
+        FDT_BEGIN_NODE = 1,
+        FDT_END_NODE = 2,
+        FDT_PROP = 3,
+        FDT_NOP = 4,
+        FDT_END = 9
+    };
+
+    enum HeaderField
+    {
+        MAGIC = 0,
+        TOTAL_SIZE,
+        OFF_DT_STRUCT,
+        OFF_DT_STRINGS,
+        OFF_MEM_RSVMAP,
+        VERSION,
+        LAST_COMP_VERSION,
+        BOOT_CPUID_PHYS,
+        SIZE_DT_STRINGS,
+        SIZE_DT_STRUCT
+    };
+
+    /**
+     * @brief State kept for each node on the path from the root to the node
+     * currently being read
+     */
+    struct Node
+    {
+        /**
+         * @brief Cells used by the `reg` properties of this node's children
+         */
+        unsigned int addressCells, sizeCells;
+
+        bool memory;
+
+        bool reservedMemory;
+
+        const unsigned char *reg;
+
+        unsigned int regLength;
+    };
+
+    unsigned int read32(const unsigned char *p)
+    {
+        return ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | p[3];
+    }
+
+    unsigned long read64(const unsigned char *p)
+    {
+        return ((unsigned long)read32(p) << 32) | read32(p + 4);
+    }
+
+    /**
+     * @brief Reads a number made of `cells` 32-bit cells
+     */
+    unsigned long readCells(const unsigned char *p, unsigned int cells)
+    {
+        unsigned long value = 0;
+        for (unsigned int i = 0; i < cells; i++)
+        {
+            value = (value << 32) | read32(p + 4 * i);
+        }
+        return value;
+    }
+
+    bool equals(const char *a, const char *b)
+    {
+        while (*a != '\0' && *a == *b)
+        {
+            a++;
+            b++;
+        }
+        return *a == *b;
+    }
+
+    /**
+     * @return true if the node name `name` is `base`, with or without a
+     * unit address
+     */
+    bool isNamed(const char *name, const char *base)
+    {
+        while (*base != '\0' && *name == *base)
+        {
+            name++;
+            base++;
+        }
+        return *base == '\0' && (*name == '\0' || *name == '@');
+    }
+
+    unsigned long align4(unsigned long n)
+    {
+        return (n + 3) & ~3UL;
+    }
+
+    int addRange(MemoryMap *map, unsigned long &count, MemoryMap::MemoryType type, unsigned long location, unsigned long size)
+    {
+        if (size == 0)
+        {
+            return ENONE;
+        }
+        count++;
+        if (map != nullptr && map->place(type, location, size) != 0)
+        {
+            return EFULL;
+        }
+        return ENONE;
+    }
+
+}
+
+DeviceTree::DeviceTree(const void *blob)
+    : blob((const unsigned char *)blob)
+{
+}
+
+bool DeviceTree::isValid() const
+{
+    if (blob == nullptr || read32(blob + 4 * MAGIC) != fdtMagic)
+    {
+        return false;
+    }
+    return read32(blob + 4 * VERSION) >= fdtCompatVersion;
+}
+
+unsigned long DeviceTree::size() const
+{
+    return isValid() ? read32(blob + 4 * TOTAL_SIZE) : 0;
+}
+
+unsigned long DeviceTree::countMemoryRegions() const
+{
+    unsigned long count = 0;
+    if (walkMemory(nullptr, count) != ENONE)
+    {
+        return 0;
+    }
+    return count;
+}
+
+int DeviceTree::readMemoryMap(MemoryMap &map) const
+{
+    unsigned long count = 0;
+    return walkMemory(&map, count);
+}
+
+int DeviceTree::walkMemory(MemoryMap *map, unsigned long &count) const
+{
+    if (!isValid())
+    {
+        return EINVAL;
+    }
+
+    unsigned long totalSize = read32(blob + 4 * TOTAL_SIZE);
+    unsigned long structOffset = read32(blob + 4 * OFF_DT_STRUCT);
+    unsigned long structSize = read32(blob + 4 * SIZE_DT_STRUCT);
+    unsigned long stringsOffset = read32(blob + 4 * OFF_DT_STRINGS);
+    unsigned long stringsSize = read32(blob + 4 * SIZE_DT_STRINGS);
+    unsigned long reserveOffset = read32(blob + 4 * OFF_MEM_RSVMAP);
+    if (structOffset + structSize > totalSize || stringsOffset + stringsSize > totalSize || reserveOffset >= totalSize)
+    {
+        return EINVAL;
+    }
+
+    // RAM has to be placed before anything that reserves part of it, so the
+    // reservation block is read after the structure block.
+    const unsigned char *p = blob + structOffset;
+    const unsigned char *end = p + structSize;
+    const char *strings = (const char *)blob + stringsOffset;
+    Node nodes[maxDepth];
+    int depth = 0;
+    nodes[0] = {2, 1, false, false, nullptr, 0};
+    bool done = false;
+    while (!done)
+    {
+        if (p + 4 > end)
+        {
+            return EINVAL;
+        }
+        unsigned int token = read32(p);
+        p += 4;
+        switch (token)
+        {
+        case FDT_BEGIN_NODE:
+        {
+            const char *name = (const char *)p;
+            while (p < end && *p != '\0')
+            {
+                p++;
+            }
+            p = blob + align4(p + 1 - blob);
+            depth++;
+            if (depth >= maxDepth)
+            {
+                return EINVAL;
+            }
+            // Depth 1 is the root, so its children sit at depth 2
+            nodes[depth] = {2, 1, depth == 2 && isNamed(name, "memory"),
+                            depth == 2 && isNamed(name, "reserved-memory"), nullptr, 0};
+            break;
+        }
+        case FDT_END_NODE:
+        {
+            if (depth <= 0)
+            {
+                return EINVAL;
+            }
+            Node &node = nodes[depth];
+            Node &parent = nodes[depth - 1];
+            bool reserved = depth == 3 && nodes[2].reservedMemory;
+            // Physical addresses never need more than two cells
+            bool supported = parent.addressCells > 0 && parent.addressCells <= 2 && parent.sizeCells <= 2;
+            unsigned int entrySize = 4 * (parent.addressCells + parent.sizeCells);
+            if (node.reg != nullptr && (node.memory || reserved) && supported)
+            {
+                MemoryMap::MemoryType type = node.memory ? MemoryMap::MemoryType::AVAILABLE
+                                                         : MemoryMap::MemoryType::UNAVAILABLE;
+                for (unsigned int i = 0; i + entrySize <= node.regLength; i += entrySize)
+                {
+                    unsigned long location = readCells(node.reg + i, parent.addressCells);
+                    unsigned long size = readCells(node.reg + i + 4 * parent.addressCells, parent.sizeCells);
+                    int status = addRange(map, count, type, location, size);
+                    if (status != ENONE)
+                    {
+                        return status;
+                    }
+                }
+            }
+            depth--;
+            break;
+        }
+        case FDT_PROP:
+        {
+            if (p + 8 > end || depth <= 0)
+            {
+                return EINVAL;
+            }
+            unsigned int length = read32(p);
+            unsigned int nameOffset = read32(p + 4);
+            const unsigned char *value = p + 8;
+            p += 8 + align4(length);
+            if (p > end || nameOffset >= stringsSize)
+            {
+                return EINVAL;
+            }
+            const char *name = strings + nameOffset;
+            Node &node = nodes[depth];
+            if (equals(name, "#address-cells") && length == 4)
+            {
+                node.addressCells = read32(value);
+            }
+            else if (equals(name, "#size-cells") && length == 4)
+            {
+                node.sizeCells = read32(value);
+            }
+            else if (equals(name, "reg"))
+            {
+                node.reg = value;
+                node.regLength = length;
+            }
+            else if (equals(name, "device_type") && depth == 2 && equals((const char *)value, "memory"))
+            {
+                node.memory = true;
+            }
+            break;
+        }
+        case FDT_NOP:
+            break;
+        case FDT_END:
+            done = true;
+            break;
+        default:
+            return EINVAL;
+        }
+    }
+
+    for (const unsigned char *entry = blob + reserveOffset; entry + 16 <= blob + totalSize; entry += 16)
+    {
+        unsigned long location = read64(entry);
+        unsigned long size = read64(entry + 8);
+        if (location == 0 && size == 0)
+        {
+            break;
+        }
+        int status = addRange(map, count, MemoryMap::MemoryType::UNAVAILABLE, location, size);
+        if (status != ENONE)
+        {
+            return status;
+        }
+    }
+    return ENONE;
+}
@@ -0,0 +1,73 @@
+#ifndef KERNEL_DEVICETREE_H
+#define KERNEL_DEVICETREE_H
+
+#include "memory/memorymap.h"
+
+namespace kernel::devices
+{
+
+/**
+ * @brief Read-only view of a flattened device tree blob, as handed to the
+ * kernel by the bootloader. Only the parts needed to discover physical
+ * memory are understood.
+ */
+class DeviceTree
+{
+public:
+
+    /**
+     * @param blob pointer through which the whole blob can be read
+     */
+    DeviceTree(const void *blob);
+
+    /**
+     * @return true if the blob has a valid header of a version this parser
+     * understands
+     */
+    bool isValid() const;
+
+    /**
+     * @return the size in bytes of the whole blob, or 0 if it is invalid
+     */
+    unsigned long size() const;
+
+    /**
+     * @brief Counts the address ranges `readMemoryMap` would place, so the
+     * caller can size a MemoryMap to hold them.
+     *
+     * @return the number of ranges, or 0 if the blob is invalid or malformed
+     */
+    unsigned long countMemoryRegions() const;
+
+    /**
+     * @brief Places every range in the `reg` property of `/memory` nodes
+     * into `map` as available RAM, then every range in the memory
+     * reservation block and under `/reserved-memory` as unavailable.
+     *
+     * @param map memory map to fill
+     * @return ENONE, EINVAL if the blob is invalid or malformed, or EFULL if
+     * `map` ran out of room
+     */
+    int readMemoryMap(memory::MemoryMap &map) const;
+
+private:
+
+    /**
+     * @brief Deepest node nesting that is tracked while walking the tree.
+     * Memory nodes never sit deeper than the children of `/reserved-memory`.
+     */
+    static const int maxDepth = 16;
+
+    const unsigned char *blob;
+
+    /**
+     * @brief Walks the memory reservation block and structure block. Ranges
+     * are placed into `map` if it is not null, and counted in `count`.
+     */
+    int walkMemory(memory::MemoryMap *map, unsigned long &count) const;
+
+};
+
+}
+
+#endif
@@ -36,7 +36,28 @@ enum class MMIOOffset : uint64_t
     MBOX_BASE = 0xB880,
     MBOX_READ = (MBOX_BASE + 0x00),
     MBOX_STATUS = (MBOX_BASE + 0x18),
-    MBOX_WRITE = (MBOX_BASE + 0x20)
+    MBOX_WRITE = (MBOX_BASE + 0x20),
+
+    /**
+     * @brief Base address for the BCM2836 core-local peripherals at physical
+     * 0x40000000. Registers below with a core stride have one copy per core.
+     */
+    LOCAL_BASE = 0x1000000,
+
+    // Routing of each core's generic timer interrupts, stride 4
+    LOCAL_TIMER_INT_CTRL = (LOCAL_BASE + 0x40),
+
+    // Routing of each core's mailbox interrupts, stride 4
+    LOCAL_MAILBOX_INT_CTRL = (LOCAL_BASE + 0x50),
+
+    // Pending interrupt sources of each core, stride 4
+    LOCAL_IRQ_SOURCE = (LOCAL_BASE + 0x60),
+
+    // Write-set register of each core's mailbox 0, stride 16
+    LOCAL_MAILBOX0_SET = (LOCAL_BASE + 0x80),
+
+    // Read and write-clear register of each core's mailbox 0, stride 16
+    LOCAL_MAILBOX0_CLEAR = (LOCAL_BASE + 0xC0)
 };
 
 /**
@@ -1,31 +1,77 @@
 #include "timer.h"
-#include "kernel.h"
-#include "util/log.h"
+#include "types/status.h"
 
 volatile unsigned int *const kernel::devices::SystemTimer::registers = (unsigned int *)0xFFFFFF803F003000;
 
 kernel::devices::SystemTimer::SystemTimer()
+    : timers(), expiring(false)
 {
-    this->delta = 50;
-    reset();
 }
 
-kernel::devices::SystemTimer::SystemTimer(unsigned int delta)
+unsigned long kernel::devices::SystemTimer::now() const
 {
-    this->delta = delta;
-    reset();
+    // Re-read the low word if it wrapped between the two reads
+    unsigned int high = registers[CHI];
+    unsigned int low = registers[CLO];
+    if (registers[CHI] != high)
+    {
+        high = registers[CHI];
+        low = registers[CLO];
+    }
+    return ((unsigned long)high << 32) | low;
 }
 
-void kernel::devices::SystemTimer::handleInterrupt(int src)
+int kernel::devices::SystemTimer::add(sched::Timer *timer, unsigned long deadline, unsigned long slack)
 {
-    reset();
-    // kernelLog(LogLevel::DEBUG, "Timer interrupt: %i", registers[CLO]);
-    kernel::kernel.switchTask();
+    int status = timers.add(timer, deadline, slack);
+    if (status == ENONE)
+    {
+        update();
+    }
+    return status;
 }
 
-void kernel::devices::SystemTimer::reset()
+void kernel::devices::SystemTimer::cancel(sched::Timer *timer)
+{
+    // Leaving the compare register alone costs at most one spurious interrupt
+    timers.cancel(timer);
+}
+
+void kernel::devices::SystemTimer::handleInterrupt(int src)
 {
-    unsigned int currentTime = registers[CLO];
-    registers[C1] = currentTime + (delta * 1000);
     registers[CS] = 0xF;
+    update();
+}
+
+void kernel::devices::SystemTimer::update()
+{
+    if (expiring)
+    {
+        return;
+    }
+    expiring = true;
+    while (true)
+    {
+        unsigned long current = now();
+        sched::Timer *timer;
+        while ((timer = timers.popDue(current)) != nullptr)
+        {
+            timer->callback(timer->data);
+        }
+
+        unsigned long delay = timers.nextExpiry() - current;
+        if (delay > maxDelay)
+        {
+            delay = maxDelay;
+        }
+        unsigned long target = current + delay;
+        registers[C1] = (unsigned int)target;
+        // A compare value the counter has already passed would not match
+        // for another 71 minutes, so check again
+        if (now() < target)
+        {
+            break;
+        }
+    }
+    expiring = false;
 }
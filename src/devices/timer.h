@@ -2,17 +2,40 @@
 #define KERNEL_TIMER_H
 
 #include "irq/interrupthandler.h"
+#include "sched/timerqueue.h"
 
 namespace kernel::devices 
 {
 
+/**
+ * @brief Driver for the BCM2835 system timer, a free-running 1 MHz counter.
+ * Rather than ticking at a fixed rate, one compare register is programmed
+ * for the earliest pending timer, so the timer only interrupts when there
+ * is work to do.
+ */
 class SystemTimer : public kernel::interrupt::InterruptHandler 
 {
 public:
 
     SystemTimer();
 
-    SystemTimer(unsigned int delta);
+    /**
+     * @return microseconds since the counter started
+     */
+    unsigned long now() const;
+
+    /**
+     * @brief Arms `timer` to fire between `deadline` and `deadline` +
+     * `slack`, both in microseconds on this clock. A deadline that has
+     * already passed fires right away.
+     * @return ENONE, or ENOMEM
+     */
+    int add(sched::Timer *timer, unsigned long deadline, unsigned long slack);
+
+    /**
+     * @brief Disarms `timer`, if it is armed.
+     */
+    void cancel(sched::Timer *timer);
 
     void handleInterrupt(int src);
 
@@ -30,12 +53,28 @@ private:
 
     static volatile unsigned int *const registers;
 
-    unsigned int delta;
+    /**
+     * @brief Longest delay programmed at once. The compare register only
+     * holds 32 bits, so later expiries are reached in several steps.
+     */
+    static const unsigned long maxDelay = 1UL << 31;
+
+    sched::TimerQueue timers;
+
+    /**
+     * @brief Set while timer callbacks are running, so timers they arm do
+     * not reprogram the hardware until all of them have run
+     */
+    bool expiring;
 
-    void reset();
+    /**
+     * @brief Runs every timer that is due, then programs the compare
+     * register for the next expiry.
+     */
+    void update();
     
 };
 
 }  // namespace kernel::devices
 
-#endif
\ No newline at end of file
+#endif
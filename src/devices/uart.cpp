@@ -2,6 +2,8 @@
 #include "mmio.h"
 #include "util/log.h"
 #include "util/string.h"
+#include "memory/usercopy.h"
+#include "types/status.h"
 #include <stdint.h>
 
 namespace kernel::devices
@@ -116,15 +118,15 @@ namespace kernel::devices
     }
 
     UART::UART()
-        : registers(nullptr), bufferIndex(0)
+        : registers(nullptr), bufferIndex(0), readers()
     {
-        memset(buffer, bufferSize, 0);
+        memset(buffer, 0, bufferSize);
     }
 
     UART::UART(void *mmio_offset)
-        : registers((uint32_t *)mmio_offset), bufferIndex(0)
+        : registers((uint32_t *)mmio_offset), bufferIndex(0), readers()
     {
-        memset(buffer, bufferSize, 0);
+        memset(buffer, 0, bufferSize);
         /*int raspi = 3;
         // Disable UART0.
         registers[CR] = 0;
@@ -261,6 +263,7 @@ namespace kernel::devices
 
     void UART::readByte()
     {
+        int start = bufferIndex;
         while (!(registers[UARTRegisters::FR] & (1 << 4)))
         {
             buffer[bufferIndex] = registers[UARTRegisters::DR];
@@ -270,6 +273,10 @@ namespace kernel::devices
                 bufferIndex = 0;
             }
         }
+        if (bufferIndex != start)
+        {
+            readers.wakeAll();
+        }
     }
 }
 
@@ -288,25 +295,44 @@ int kernel::devices::UART::UARTContext::read(void *buffer, int n)
     int c = 0;
     while (pos != uart.bufferIndex && c < n)
     {
-        s[c] = uart.buffer[pos];
-        c++;
-        pos++;
+        int run = (uart.bufferIndex > pos ? uart.bufferIndex : uart.bufferSize) - pos;
+        run = run < n - c ? run : n - c;
+        if (kernel::memory::copy_to_user(s + c, uart.buffer + pos, run) != ENONE)
+        {
+            return c > 0 ? c : EINVAL;
+        }
+        c += run;
+        pos += run;
         if (pos >= uart.bufferSize)
         {
             pos = 0;
         }
     }
+    if (c == 0 && n > 0)
+    {
+        return EAGAIN;
+    }
     return c;
 }
 
 int kernel::devices::UART::UARTContext::write(const void *buffer, int n)
 {
-    for (int i = 0; i < n; i++)
+    // The device is slow anyway, so bounce through a small kernel buffer
+    char chunk[64];
+    for (int i = 0; i < n; i += sizeof(chunk))
     {
-        uart << ((char *)buffer)[i];
-        if (((char *)buffer)[i] == '\n')
+        int size = n - i < (int)sizeof(chunk) ? n - i : sizeof(chunk);
+        if (kernel::memory::copy_from_user(chunk, (const char *)buffer + i, size) != ENONE)
         {
-            uart << '\r';
+            return i > 0 ? i : EINVAL;
+        }
+        for (int j = 0; j < size; j++)
+        {
+            uart << chunk[j];
+            if (chunk[j] == '\n')
+            {
+                uart << '\r';
+            }
         }
     }
     return n;
@@ -321,3 +347,8 @@ kernel::fs::FileContext *kernel::devices::UART::UARTContext::copy()
     }
     return f;
 }
+
+kernel::sched::WaitQueue *kernel::devices::UART::UARTContext::getReadWaiters()
+{
+    return &uart.readers;
+}
@@ -5,6 +5,7 @@
 #include "irq/interrupthandler.h"
 #include "containers/binary_search_tree.h"
 #include "fs/filecontext.h"
+#include "sched/waitqueue.h"
 #include <stdint.h>
 
 namespace kernel::devices
@@ -55,6 +56,8 @@ namespace kernel::devices
 
             kernel::fs::FileContext *copy();
 
+            kernel::sched::WaitQueue *getReadWaiters();
+
         private:
             UART &uart;
 
@@ -69,6 +72,15 @@ namespace kernel::devices
 
         int bufferIndex;
 
+        /**
+         * @brief Processes waiting for input
+         */
+        kernel::sched::WaitQueue readers;
+
+        /**
+         * @brief Drains the receive FIFO into `buffer`, waking blocked
+         * readers if anything arrived.
+         */
         void readByte();
     };
 
@@ -54,6 +54,12 @@ byte *DiskInterface::read(int sector_index)
     return buffer;
 }
 
+// points straight into the disk image, so nothing is copied
+byte *DiskInterface::locate(int sector_index)
+{
+    return disk + bytes_per_sector * sector_index;
+}
+
 void DiskInterface::write(int sector_index, const byte *buffer)
 {
     int offset = bytes_per_sector * sector_index;
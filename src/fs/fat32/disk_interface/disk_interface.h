@@ -11,6 +11,7 @@ public:
     ~DiskInterface();
 
     byte *read(int sector_index);
+    byte *locate(int sector_index);
     void write(int sector_index, const byte *buffer);
 
 private:
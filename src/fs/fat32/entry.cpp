@@ -61,6 +61,35 @@ byte *FAT32::Entry::read_data(int sector_offset)
     return fs->di->read(target_sector_offset);
 }
 
+/* Finds the disk sector holding the byte at the given offset into the entry's data, and how many
+bytes from that byte onwards are stored in consecutive clusters on disk, will fail if: entry isn't
+a file, the byte offset is past the clusters allocated to the file. */
+int FAT32::Entry::data_extent(int byte_offset, int &sector_index, int &contiguous_bytes)
+{
+    if (type != FILE || byte_offset < 0)
+        return failure; // entries not of type FILE don't have readable data
+
+    int target_cluster = byte_offset / fs->bytes_per_cluster;
+
+    if (target_cluster >= (int)fat_allocations.size())
+        return failure; // can't read data that isn't allocated to the entry
+
+    int cluster_offset = fat_entry_to_cluster_offset(fat_allocations[target_cluster]);
+    int cluster_byte_offset = byte_offset % fs->bytes_per_cluster;
+    sector_index = (cluster_offset * fs->sectors_per_cluster) + (cluster_byte_offset / fs->bytes_per_sector);
+    contiguous_bytes = fs->bytes_per_cluster - cluster_byte_offset;
+
+    // keep going while the next cluster follows right after the last one
+    for (int i = target_cluster + 1; i < (int)fat_allocations.size(); i++)
+    {
+        if (fat_entry_to_cluster_offset(fat_allocations[i]) != cluster_offset + (i - target_cluster))
+            break;
+        contiguous_bytes += fs->bytes_per_cluster;
+    }
+
+    return success;
+}
+
 /* Writes the given byte data to the given sector offset (using zero-indexing) into the provided data
 buffer, will fail if: the entry isn't a file (e.g. a directory), there isn't enough space left on disk
 to allocate more clusters if required. */
@@ -110,6 +110,28 @@ int FAT32::read_file(string file_path, int sector_offset, byte *&buffer)
     return success;
 }
 
+/* Finds the file specified by the given file path and fills the given location parameter with a
+pointer straight into the disk image at the given byte offset of the file's data, and the given
+length parameter with how many bytes from there on are stored contiguously in the image, will
+fail if it can't find the file, or if the byte offset is past the clusters allocated to the file. */
+int FAT32::file_extent(string file_path, int byte_offset, byte *&location, int &length)
+{
+    location = nullptr;
+
+    Entry *entry = find_entry(file_path);
+
+    if (entry == nullptr)
+        return failure; // couldn't find file
+
+    int sector_index;
+    if (!entry->data_extent(byte_offset, sector_index, length))
+        return failure; // offset isn't allocated to the file
+
+    location = di->locate(sector_index) + byte_offset % bytes_per_sector;
+
+    return success;
+}
+
 /* Finds the file specified by the given file path and writes the byte data at the given sector
 offset (using zero-indexing) into the provided data buffer, will allocate space for the buffer
 so don't allocate space for the buffer before passing, will fail if: it can't find the file,
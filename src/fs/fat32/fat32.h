@@ -34,6 +34,7 @@ public:
     int file_type(string file_path, FileType &type);
     int file_size(string file_path, int &size);
     int read_file(string file_path, int sector_offset, byte *&buffer);
+    int file_extent(string file_path, int byte_offset, byte *&location, int &length);
     int write_file(string file_path, int sector_offset, const byte *data);
     int create_file(string file_path);
     int remove_file(string file_path);
@@ -97,6 +98,7 @@ private:
         vector<int> fat_allocations;
 
         byte *read_data(int sector_offset);
+        int data_extent(int byte_offset, int &sector_index, int &contiguous_bytes);
         int write_data(int sector_offset, const byte *data);
 
         int new_dir_entry(Entry *par_dir, string name, EntryAttribute type);
@@ -2,6 +2,9 @@
 #include "util/string.h"
 #include "util/log.h"
 #include "types/status.h"
+#include "memory/usercopy.h"
+#include "memory/mmap.h"
+#include "memory/pageallocator.h"
 
 kernel::fs::FileContextFAT32::FileContextFAT32(FAT32 &fs, string path)
     : fs(fs), path(path), sectorBuffer(nullptr), pos(0), lastSector(-1)
@@ -53,8 +56,11 @@ int kernel::fs::FileContextFAT32::read(void *buffer, int n)
                 break;
             }
         }
-        int c = (n > bytesLeft) ? bytesLeft : n;
-        memcpy(buffer + count, sectorBuffer + offset, c);
+        int c = (n - count > bytesLeft) ? bytesLeft : n - count;
+        if (kernel::memory::copy_to_user(buffer + count, sectorBuffer + offset, c) != ENONE)
+        {
+            return count > 0 ? count : EINVAL;
+        }
         count += c;
         pos += c;
     }
@@ -66,6 +72,94 @@ int kernel::fs::FileContextFAT32::write(const void *buffer, int n)
     return EIO;
 }
 
+int kernel::fs::FileContextFAT32::map(void *addr, unsigned long offset, unsigned long size, int flags)
+{
+    using namespace kernel::memory;
+    int filesize;
+    if (fs.file_size(path, filesize) == failure)
+    {
+        return EIO;
+    }
+    if (size == 0)
+    {
+        size = offset < (unsigned long)filesize ? filesize - offset : 0;
+    }
+    size = (size + page_size - 1) & ~(page_size - 1);
+    if ((unsigned long)addr % page_size != 0 || offset % page_size != 0 || size == 0 || !is_user_range(addr, size))
+    {
+        return EINVAL;
+    }
+
+    AddressSpace *addressSpace = getActiveAddressSpace();
+    if (addressSpace == nullptr)
+    {
+        return EINVAL;
+    }
+
+    flags = (flags & (PAGE_RW | PAGE_EXE)) | PAGE_USER;
+    int status = addressSpace->addRegion(addr, size, flags, AddressSpace::Region::Type::FILE);
+    if (status != ENONE)
+    {
+        return status;
+    }
+
+    beginTLBBatch();
+    for (unsigned long p = 0; p < size; p += page_size)
+    {
+        physaddr_t frame = pageFrame(offset + p, filesize, flags & PAGE_RW);
+        if (frame == PageAllocator::NOMEM || map_region(addr + p, page_size, frame, flags) != ENONE)
+        {
+            if (frame != PageAllocator::NOMEM)
+            {
+                pageAllocator.release(frame);
+            }
+            free_region(addr, p);
+            addressSpace->removeRegion(addr, size);
+            status = ENOMEM;
+            break;
+        }
+    }
+    endTLBBatch();
+    return status;
+}
+
+physaddr_t kernel::fs::FileContextFAT32::pageFrame(unsigned long offset, unsigned long fileSize, bool writable)
+{
+    using namespace kernel::memory;
+    byte *location;
+    int length;
+
+    // Whole read-only pages already laid out like a page can be shared
+    if (!writable && offset + page_size <= fileSize && fs.file_extent(path, offset, location, length) == success && length >= (int)page_size)
+    {
+        physaddr_t frame = getPageFrame(location);
+        if (frame != 0 && frame % page_size == 0)
+        {
+            return frame;
+        }
+    }
+
+    physaddr_t frame = pageAllocator.reserveZeroed();
+    if (frame == PageAllocator::NOMEM)
+    {
+        return PageAllocator::NOMEM;
+    }
+
+    // Gather the page from however many runs of clusters it spans
+    byte *dest = (byte *)physicalToLinear(frame);
+    unsigned long end = offset + page_size < fileSize ? offset + page_size : fileSize;
+    for (unsigned long pos = offset; pos < end; pos += length)
+    {
+        if (fs.file_extent(path, pos, location, length) == failure)
+        {
+            break;
+        }
+        length = (unsigned long)length < end - pos ? length : end - pos;
+        memcpy(dest + (pos - offset), location, length);
+    }
+    return frame;
+}
+
 kernel::fs::FileContext *kernel::fs::FileContextFAT32::copy()
 {
     FileContextFAT32 *f = new FileContextFAT32(fs, path);
@@ -4,6 +4,7 @@
 #include "../filecontext.h"
 #include "fat32.h"
 #include "containers/string.h"
+#include "types/physaddr.h"
 
 namespace kernel::fs
 {
@@ -18,9 +19,26 @@ namespace kernel::fs
 
         int write(const void *buffer, int n);
 
+        /**
+         * @brief Maps part of the file. Read-only pages whose data sits
+         * page-aligned and contiguous in the ramfs image are mapped straight
+         * to the image's frames; every other page gets a private copy.
+         * Pages past the end of the file are zero-filled.
+         */
+        int map(void *addr, unsigned long offset, unsigned long size, int flags);
+
         FileContext *copy();
 
     private:
+        /**
+         * @brief Finds the frame to map for the page of the file starting at
+         * `offset`.
+         *
+         * @return a frame of the ramfs image, a new frame holding a copy of
+         * the page, or PageAllocator::NOMEM
+         */
+        physaddr_t pageFrame(unsigned long offset, unsigned long fileSize, bool writable);
+
         FAT32 &fs;
 
         string path;
@@ -1,5 +1,36 @@
 #include "filecontext.h"
+#include "types/status.h"
+
+kernel::fs::FileContext::FileContext()
+    : flags(0)
+{
+}
 
 kernel::fs::FileContext::~FileContext()
 {
 }
+
+int kernel::fs::FileContext::map(void *, unsigned long, unsigned long, int)
+{
+    return ENOSYS;
+}
+
+kernel::sched::WaitQueue *kernel::fs::FileContext::getReadWaiters()
+{
+    return nullptr;
+}
+
+kernel::sched::WaitQueue *kernel::fs::FileContext::getWriteWaiters()
+{
+    return nullptr;
+}
+
+int kernel::fs::FileContext::getFlags() const
+{
+    return flags;
+}
+
+void kernel::fs::FileContext::setFlags(int flags)
+{
+    this->flags = flags;
+}
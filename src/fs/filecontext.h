@@ -3,18 +3,76 @@
 
 #include "util/hasrefcount.h"
 
+namespace kernel::sched
+{
+    class WaitQueue;
+}
+
 namespace kernel::fs
 {
     class FileContext : public HasRefcount
     {
     public:
+        FileContext();
+
         virtual ~FileContext() = 0;
 
+        /**
+         * @brief Reads up to `n` bytes into `buffer`, which is a user
+         * address and must only be accessed with `copy_to_user`.
+         *
+         * @return the number of bytes read, EAGAIN if nothing can be read
+         * yet but may be later, or another error code
+         */
         virtual int read(void *buffer, int n) = 0;
 
+        /**
+         * @brief Writes up to `n` bytes from `buffer`, which is a user
+         * address and must only be accessed with `copy_from_user`.
+         *
+         * @return the number of bytes written, EAGAIN if nothing can be
+         * written yet but may be later, or another error code
+         */
         virtual int write(const void *buffer, int n) = 0;
 
+        /**
+         * @brief Maps part of the object this context refers to into the
+         * active address space at `addr`.
+         *
+         * @param addr page-aligned address to map the object at
+         * @param offset page-aligned offset into the object of the first
+         * byte to map
+         * @param size number of bytes to map, or 0 for the rest of the
+         * object
+         * @param flags access flags for the mapped pages
+         * @return ENONE on success, ENOSYS if the object cannot be mapped,
+         * or another error code
+         */
+        virtual int map(void *addr, unsigned long offset, unsigned long size, int flags);
+
         virtual FileContext *copy() = 0;
+
+        /**
+         * @return the queue to wait on when `read` returns EAGAIN, or
+         * nullptr if reads never wait
+         */
+        virtual sched::WaitQueue *getReadWaiters();
+
+        /**
+         * @return the queue to wait on when `write` returns EAGAIN, or
+         * nullptr if writes never wait
+         */
+        virtual sched::WaitQueue *getWriteWaiters();
+
+        /**
+         * @return flags from `file_flags_t`
+         */
+        int getFlags() const;
+
+        void setFlags(int flags);
+
+    private:
+        int flags;
     };
 }
 
@@ -1,9 +1,10 @@
 #include "pipe.h"
 #include "filecontext.h"
 #include "types/status.h"
+#include "memory/usercopy.h"
 
 kernel::fs::Pipe::Pipe()
-    : writePos(0), readPos(0), readerCount(0), writerCount(0)
+    : writePos(0), readPos(0), readerCount(0), writerCount(0), readers(), writers()
 {
 }
 
@@ -18,13 +19,24 @@ int kernel::fs::Pipe::put(void *data, int n)
         return EPIPE;
     }
 
-    char *s = (char *)data;
+    // Copy straight from the caller in at most two runs, one on either side
+    // of the end of the ring. One slot is always left empty.
+    const char *s = (const char *)data;
     int c = 0;
-    while (c < n && !(writePos == PIPE_SIZE - 1 && readPos == 0) && !(writePos + 1 == readPos))
+    while (c < n)
     {
-        buffer[writePos] = s[c];
-        c++;
-        writePos++;
+        int run = readPos > writePos ? readPos - writePos - 1 : PIPE_SIZE - writePos - (readPos == 0 ? 1 : 0);
+        if (run <= 0)
+        {
+            break;
+        }
+        run = run < n - c ? run : n - c;
+        if (kernel::memory::copy_from_user(buffer + writePos, s + c, run) != ENONE)
+        {
+            return c > 0 ? c : EINVAL;
+        }
+        c += run;
+        writePos += run;
         if (writePos >= PIPE_SIZE)
         {
             writePos = 0;
@@ -33,12 +45,13 @@ int kernel::fs::Pipe::put(void *data, int n)
 
     if (n > 0 && c == 0)
     {
-        return EFULL;
+        return EAGAIN;
     }
-    else
+    if (c > 0)
     {
-        return c;
+        readers.wakeAll();
     }
+    return c;
 }
 
 int kernel::fs::Pipe::read(void *data, int n)
@@ -47,14 +60,23 @@ int kernel::fs::Pipe::read(void *data, int n)
     int c = 0;
     while (readPos != writePos && c < n)
     {
-        s[c] = buffer[readPos];
-        c++;
-        readPos++;
+        int run = (writePos > readPos ? writePos : PIPE_SIZE) - readPos;
+        run = run < n - c ? run : n - c;
+        if (kernel::memory::copy_to_user(s + c, buffer + readPos, run) != ENONE)
+        {
+            return c > 0 ? c : EINVAL;
+        }
+        c += run;
+        readPos += run;
         if (readPos >= PIPE_SIZE)
         {
             readPos = 0;
         }
     }
+    if (c > 0)
+    {
+        writers.wakeAll();
+    }
     return c;
 }
 
@@ -76,6 +98,11 @@ void kernel::fs::Pipe::addReader()
 void kernel::fs::Pipe::removeReader()
 {
     readerCount--;
+    if (readerCount == 0)
+    {
+        // Blocked writers now fail with EPIPE
+        writers.wakeAll();
+    }
 }
 
 void kernel::fs::Pipe::addWriter()
@@ -86,6 +113,11 @@ void kernel::fs::Pipe::addWriter()
 void kernel::fs::Pipe::removeWriter()
 {
     writerCount--;
+    if (writerCount == 0)
+    {
+        // Blocked readers now see the end of the pipe
+        readers.wakeAll();
+    }
 }
 
 int kernel::fs::Pipe::getReaderCount() const
@@ -120,6 +152,10 @@ int kernel::fs::Pipe::PipeReader::read(void *buffer, int n)
     {
         return EEOF;
     }
+    else if (c == 0 && n > 0)
+    {
+        return EAGAIN;
+    }
     else
     {
         return c;
@@ -136,6 +172,16 @@ kernel::fs::FileContext *kernel::fs::Pipe::PipeReader::copy()
     return new PipeReader(pipe);
 }
 
+kernel::sched::WaitQueue *kernel::fs::Pipe::PipeReader::getReadWaiters()
+{
+    return &pipe->readers;
+}
+
+kernel::sched::WaitQueue *kernel::fs::Pipe::PipeReader::getWriteWaiters()
+{
+    return nullptr;
+}
+
 kernel::fs::Pipe::PipeWriter::PipeWriter(Pipe *pipe)
     : pipe(pipe)
 {
@@ -165,3 +211,13 @@ kernel::fs::FileContext *kernel::fs::Pipe::PipeWriter::copy()
 {
     return new PipeWriter(pipe);
 }
+
+kernel::sched::WaitQueue *kernel::fs::Pipe::PipeWriter::getReadWaiters()
+{
+    return nullptr;
+}
+
+kernel::sched::WaitQueue *kernel::fs::Pipe::PipeWriter::getWriteWaiters()
+{
+    return &pipe->writers;
+}
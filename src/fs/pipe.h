@@ -3,6 +3,7 @@
 
 #include "util/hasrefcount.h"
 #include "filecontext.h"
+#include "sched/waitqueue.h"
 
 namespace kernel::fs
 {
@@ -14,8 +15,19 @@ namespace kernel::fs
 
         ~Pipe();
 
+        /**
+         * @brief Copies as much of `data` into the pipe as fits, waking
+         * blocked readers if any of it did.
+         * @return the number of bytes written, EAGAIN if the pipe is full,
+         * EPIPE if there are no readers, or EINVAL
+         */
         int put(void *data, int n);
 
+        /**
+         * @brief Copies up to `n` bytes out of the pipe, waking blocked
+         * writers if any were read.
+         * @return the number of bytes read, or EINVAL
+         */
         int read(void *data, int n);
 
         FileContext *createReader();
@@ -43,6 +55,16 @@ namespace kernel::fs
 
         int readerCount, writerCount;
 
+        /**
+         * @brief Processes waiting for data, or for the last writer to close
+         */
+        sched::WaitQueue readers;
+
+        /**
+         * @brief Processes waiting for room, or for the last reader to close
+         */
+        sched::WaitQueue writers;
+
         class PipeReader : public FileContext
         {
         public:
@@ -56,6 +78,10 @@ namespace kernel::fs
 
             FileContext *copy();
 
+            sched::WaitQueue *getReadWaiters();
+
+            sched::WaitQueue *getWriteWaiters();
+
         private:
             Pipe *pipe;
         };
@@ -73,6 +99,10 @@ namespace kernel::fs
 
             FileContext *copy();
 
+            sched::WaitQueue *getReadWaiters();
+
+            sched::WaitQueue *getWriteWaiters();
+
         private:
             Pipe *pipe;
         };
@@ -20,6 +20,13 @@ namespace kernel::interrupt
          */
         static void init();
 
+        /**
+         * @brief Prepares the calling processor to take interrupts, with
+         * them disabled. `init()` does this for the processor that calls it;
+         * every other processor must call this itself.
+         */
+        static void initCpu();
+
         /**
          * @brief Enable interrupts.
          */
@@ -45,6 +52,15 @@ namespace kernel::interrupt
          */
         static void callHandler(int id);
 
+        /**
+         * @brief Stops the processor until an interrupt is pending. Works
+         * with interrupts disabled, so the kernel can idle without returning
+         * to a process. The caller passes the result to `callHandler()`.
+         * @return the id of the pending interrupt, or -1 if the processor
+         * woke for some other reason
+         */
+        static int waitForInterrupt();
+
     private:
         /**
          * @brief Maximum size of the interrupt handler array. Must be at least as
@@ -9,9 +9,225 @@
 #include "fs/fat32/filecontextfat32.h"
 #include "types/status.h"
 #include "fs/pipe.h"
+#include "memory/sharedmemory.h"
+#include "memory/usercopy.h"
+#include "memory/kernelstack.h"
+#include "irq/interrupts.h"
+#include "types/fileflags.h"
 
 kernel::Kernel kernel::kernel;
 
+/**
+ * @brief Number of pages cleared for the zeroed page pool at each task
+ * switch.
+ */
+static const unsigned long zeroedRefillBudget = 8;
+
+/**
+ * @brief Size of the virtual address range reserved for the kernel heap,
+ * which must end below the MMIO mapping at 0x3F000000.
+ */
+static const unsigned long heapReserveSize = 1UL << 29;
+
+/**
+ * @brief Longest path or argument string, including the terminator, that
+ * syscalls will copy in from user memory.
+ */
+static const unsigned long maxStringLength = 4096;
+
+/**
+ * @brief Number of user pointers read at once when copying a string array
+ */
+static const unsigned long pointerBatchSize = 16;
+
+/**
+ * @brief Microseconds by which timers the kernel arms may fire late, so
+ * that timers due close together share one interrupt
+ */
+static const unsigned long timerSlack = 50;
+
+/**
+ * @brief Highest address at which the kernel places mappings whose address
+ * it chooses. Leaves room below the user stack.
+ */
+static const unsigned long mmapBase = 0x7000000000;
+
+static void wakeSleeper(void *data)
+{
+    kernel::kernel.wake((kernel::sched::Process *)data);
+}
+
+static void runIdle()
+{
+    kernel::kernel.idle();
+}
+
+/**
+ * @brief Sets the result of a read or write that returned `status`. If it
+ * would have blocked and the descriptor allows that, the caller waits on
+ * `waiters` instead and repeats the call once woken.
+ */
+static void finishTransfer(kernel::fs::FileContext *fc, int status, kernel::sched::WaitQueue *waiters)
+{
+    if (status == EAGAIN && waiters != nullptr && (fc->getFlags() & FILE_NONBLOCK) == 0)
+    {
+        kernel::kernel.block(*waiters);
+        return;
+    }
+    kernel::kernel.setCallerReturn(status);
+}
+
+/**
+ * @brief Frees `addressSpace`, built by a failed exec while it was loaded,
+ * and loads the caller's `previous` address space again.
+ */
+static void abandonAddressSpace(kernel::memory::AddressSpace *addressSpace, kernel::memory::AddressSpace *previous)
+{
+    using namespace kernel::memory;
+    // The tables are reclaimed once another address space is loaded
+    destoryAddressSpace(*addressSpace);
+    delete addressSpace;
+    if (previous != nullptr)
+    {
+        loadAddressSpace(*previous);
+    }
+}
+
+/**
+ * @brief Finds the highest page-aligned range of `size` bytes below
+ * `mmapBase` that overlaps no region and no mapped page of the active
+ * address space.
+ *
+ * @return the start of the range, or nullptr if there is none
+ */
+static void *findFreeRange(kernel::memory::AddressSpace &addressSpace, unsigned long size)
+{
+    using namespace kernel::memory;
+    unsigned long candidate = mmapBase - size;
+    while (size <= mmapBase && candidate >= page_size)
+    {
+        // Move below anything in the way, then look again
+        unsigned long conflict = 0;
+        for (AddressSpace::Region *r = addressSpace.firstRegion(); r != nullptr; r = r->next)
+        {
+            if ((unsigned long)r->base < candidate + size && (unsigned long)r->end() > candidate)
+            {
+                conflict = (unsigned long)r->base;
+            }
+        }
+        for (unsigned long p = candidate + size; conflict == 0 && p > candidate; p -= page_size)
+        {
+            if (getPageFrame((void *)(p - page_size)) != 0)
+            {
+                conflict = p - page_size;
+            }
+        }
+
+        if (conflict == 0)
+        {
+            return (void *)candidate;
+        }
+        else if (conflict < size)
+        {
+            break;
+        }
+        candidate = conflict - size;
+    }
+    return nullptr;
+}
+
+/**
+ * @brief Copies a user string into a new heap buffer.
+ *
+ * @return the copy, or nullptr if the string could not be read, was too
+ * long, or there was not enough memory
+ */
+static char *copyString(const char *str)
+{
+    using namespace kernel::memory;
+    char *scratch = new char[maxStringLength];
+    if (scratch == nullptr)
+    {
+        return nullptr;
+    }
+
+    char *copy = nullptr;
+    long length = strncpy_from_user(scratch, str, maxStringLength);
+    if (length >= 0 && (copy = new char[length + 1]) != nullptr)
+    {
+        memcpy(copy, scratch, length + 1);
+    }
+    delete[] scratch;
+    return copy;
+}
+
+static void freeStringArray(char **array)
+{
+    for (int i = 0; array[i] != nullptr; i++)
+    {
+        delete[] array[i];
+    }
+    delete[] array;
+}
+
+/**
+ * @brief Copies a null-terminated array of user strings into the heap.
+ *
+ * @return the copy, terminated by nullptr, or nullptr if any part of the
+ * array could not be read or there was not enough memory
+ */
+static char **copyStringArray(char *const array[])
+{
+    using namespace kernel::memory;
+
+    // Find the terminator a batch of pointers at a time, never reading past
+    // the page it is in
+    char *batch[pointerBatchSize];
+    unsigned long count = 0;
+    bool found = false;
+    while (!found)
+    {
+        unsigned long pageLeft = (page_size - (unsigned long)(array + count) % page_size) / sizeof(char *);
+        unsigned long n = pageLeft == 0 ? 1 : (pageLeft < pointerBatchSize ? pageLeft : pointerBatchSize);
+        if (copy_from_user(batch, array + count, n * sizeof(char *)) != ENONE)
+        {
+            return nullptr;
+        }
+        for (unsigned long i = 0; i < n && !found; i++)
+        {
+            found = batch[i] == nullptr;
+            count += found ? 0 : 1;
+        }
+    }
+
+    char **copy = new char *[count + 1];
+    if (copy == nullptr)
+    {
+        return nullptr;
+    }
+    if (copy_from_user(copy, array, count * sizeof(char *)) != ENONE)
+    {
+        delete[] copy;
+        return nullptr;
+    }
+    copy[count] = nullptr;
+    for (unsigned long i = 0; i < count; i++)
+    {
+        copy[i] = copyString(copy[i]);
+        if (copy[i] == nullptr)
+        {
+            // Entries after i still hold user pointers, so free by hand
+            for (unsigned long j = 0; j < i; j++)
+            {
+                delete[] copy[j];
+            }
+            delete[] copy;
+            return nullptr;
+        }
+    }
+    return copy;
+}
+
 class PipeReadContext : public kernel::fs::FileContext
 {
     int read(void *buffer, int n);
@@ -38,50 +254,99 @@ void (*syscall_table[])(long, long, long, long) = {
     (void (*)(long, long, long, long))kernel::syscall_read,
     (void (*)(long, long, long, long))kernel::syscall_write,
     (void (*)(long, long, long, long))kernel::syscall_fddup,
-    (void (*)(long, long, long, long))kernel::syscall_create_pipe};
+    (void (*)(long, long, long, long))kernel::syscall_create_pipe,
+    (void (*)(long, long, long, long))kernel::syscall_fork,
+    (void (*)(long, long, long, long))kernel::syscall_shm_create,
+    (void (*)(long, long, long, long))kernel::syscall_shm_map,
+    (void (*)(long, long, long, long))kernel::syscall_meminfo,
+    (void (*)(long, long, long, long))kernel::syscall_mmap_file,
+    (void (*)(long, long, long, long))kernel::syscall_setpriority,
+    (void (*)(long, long, long, long))kernel::syscall_nanosleep,
+    (void (*)(long, long, long, long))kernel::syscall_setflags};
 
 kernel::sched::Context *do_syscall(unsigned long id, unsigned long arg1, unsigned long arg2, unsigned long arg3, unsigned long arg4, kernel::sched::Context *ctx)
 {
     using namespace kernel::sched;
-    kernel::kernel.getActiveProcess()->storeContext(ctx);
+    kernel::kernel.enterKernel(ctx);
     syscall_table[id](arg1, arg2, arg3, arg4);
+    if (kernel::kernel.getActiveProcess() != nullptr)
+    {
+        kernel::kernel.checkPreemption();
+    }
     // kernelLog(LogLevel::DEBUG, "Returning from call %i:\n\tpc = %016x\n\tsp=%016x", id, ctx->getProgramCounter(), ctx->getStackPointer());
-    return kernel::kernel.getActiveProcess()->getContext();
+    return kernel::kernel.leaveKernel();
+}
+
+void kernel_lock_release()
+{
+    kernel::kernel.lock.release();
 }
 
 void kernel::syscall_printk(const char *str)
 {
-    printf(str);
+    using namespace kernel::memory;
+    char buffer[256];
+    long length;
+    while ((length = strncpy_from_user(buffer, str, sizeof(buffer))) == EFULL)
+    {
+        buffer[sizeof(buffer) - 1] = '\0';
+        printf("%s", buffer);
+        str += sizeof(buffer) - 1;
+    }
+    if (length < 0)
+    {
+        kernel.setCallerReturn(EINVAL);
+        return;
+    }
+    printf("%s", buffer);
     kernel.setCallerReturn(ENONE);
 }
 
 void kernel::syscall_mmap(void *ptr, unsigned long size, int flags)
 {
     using namespace kernel::memory;
-    physaddr_t frame = pageAllocator.reserve(size);
-    if (frame == PageAllocator::NOMEM)
+    size = (size + page_size - 1) & ~(page_size - 1);
+    if ((unsigned long)ptr % page_size != 0 || size == 0 || !is_user_range(ptr, size))
     {
-        kernel.setCallerReturn(ENOMEM);
-    }
-    else
-    {
-        kernel.setCallerReturn(map_region(ptr, size, frame, flags | PAGE_USER));
+        kernel.setCallerReturn(EINVAL);
+        return;
     }
+
+    // Pages are backed when first touched; see handlePageFault(). Only
+    // shm_map may create shared mappings, so other flags are ignored.
+    AddressSpace *addressSpace = kernel.getActiveProcess()->getAddressSpace();
+    kernel.setCallerReturn(addressSpace->addRegion(ptr, size, (flags & (PAGE_RW | PAGE_EXE)) | PAGE_USER, AddressSpace::Region::Type::ANONYMOUS));
 }
 
 void kernel::syscall_munmap(void *ptr, unsigned long size)
 {
     using namespace kernel::memory;
-    unmap_region(ptr, size);
-    kernel.setCallerReturn(ENONE);
+    size = (size + page_size - 1) & ~(page_size - 1);
+    if ((unsigned long)ptr % page_size != 0 || size == 0 || !is_user_range(ptr, size))
+    {
+        kernel.setCallerReturn(EINVAL);
+        return;
+    }
+
+    int status = kernel.getActiveProcess()->getAddressSpace()->removeRegion(ptr, size);
+    if (status == ENONE)
+    {
+        free_region(ptr, size);
+    }
+    kernel.setCallerReturn(status);
 }
 
 void kernel::syscall_clone(int (*fn)(void *), void *stack, void *userdata, int flags)
 {
     using namespace kernel::sched;
     Process *newProcess = kernel.getActiveProcess()->clone(kernel.nextPid(), (void *)fn, stack, userdata);
+    if (newProcess == nullptr)
+    {
+        kernel.setCallerReturn(ENOMEM);
+        return;
+    }
 
-    kernel.addProcess(*newProcess);
+    kernel.addProcess(newProcess);
     kernel.setCallerReturn(ENONE);
 }
 
@@ -100,69 +365,32 @@ void kernel::syscall_exec(const char *path, char *const argv[], char *const envp
         return;
     }
 
-    int argc = 0;
-    while (argv[argc] != nullptr)
+    char *pathCopy = copyString(path);
+    char **argvCopy = copyStringArray(argv);
+    char **envpCopy = copyStringArray(envp);
+    if (pathCopy == nullptr || argvCopy == nullptr || envpCopy == nullptr)
     {
-        argc++;
-    }
-
-    int envc = 0;
-    while (envp[envc] != nullptr)
-    {
-        envc++;
-    }
-
-    char **argvCopy = new char *[argc + 1];
-    for (int i = 0; i <= argc; i++)
-    {
-        if (argv[i] != nullptr)
-        {
-            argvCopy[i] = new char[strlen(argv[i]) + 1];
-            strcpy(argvCopy[i], argv[i]);
-        }
-        else
-        {
-            argvCopy[i] = nullptr;
-        }
+        kernel.setCallerReturn(EINVAL);
     }
-
-    char **envpCopy = new char *[envc + 1];
-    for (int i = 0; i <= envc; i++)
+    else
     {
-        if (envp[i] != nullptr)
+        int status;
+        if ((status = kernel.exec(pathCopy, argvCopy, envpCopy)) != ENONE)
         {
-            envpCopy[i] = new char[strlen(envp[i]) + 1];
-            strcpy(envpCopy[i], envp[i]);
-        }
-        else
-        {
-            envpCopy[i] = nullptr;
+            kernel.setCallerReturn(status);
         }
     }
 
-    char *pathCopy = (char *)rmalloc(strlen(path) + 1);
-    strcpy(pathCopy, path);
-
-    int status;
-    if ((status = kernel.exec(path, argvCopy, envpCopy)) != ENONE)
+    if (argvCopy != nullptr)
     {
-        kernel.setCallerReturn(status);
+        freeStringArray(argvCopy);
     }
-
-    for (int i = 0; argvCopy[i] != nullptr; i++)
+    if (envpCopy != nullptr)
     {
-        delete argvCopy[i];
+        freeStringArray(envpCopy);
     }
-
-    for (int i = 0; envpCopy[i] != nullptr; i++)
-    {
-        delete envpCopy[i];
-    }
-
-    delete envpCopy;
-    delete argvCopy;
     // kernelLog(LogLevel::DEBUG, "Returning exec() into %s", pathCopy);
-    rfree(pathCopy);
+    delete[] pathCopy;
 }
 
 void kernel::syscall_yield()
@@ -208,14 +436,23 @@ void kernel::syscall_open(const char *path, int flags)
         return;
     }
 
+    char *pathCopy = copyString(path);
+    if (pathCopy == nullptr)
+    {
+        kernel.setCallerReturn(EINVAL);
+        return;
+    }
+
     FileType type;
-    if (kernel.getRamFS()->file_type(path, type) == failure || type != File)
+    if (kernel.getRamFS()->file_type(pathCopy, type) == failure || type != File)
     {
+        delete[] pathCopy;
         kernel.setCallerReturn(ENOFILE);
         return;
     }
 
-    FileContext *fc = new FileContextFAT32(*kernel.getRamFS(), path);
+    FileContext *fc = new FileContextFAT32(*kernel.getRamFS(), pathCopy);
+    delete[] pathCopy;
     int fd = kernel.getActiveProcess()->storeFileContext(fc);
     kernel.setCallerReturn(fd);
 }
@@ -247,7 +484,7 @@ void kernel::syscall_read(int fd, void *buffer, unsigned long size)
     }
 
     int count = fc->read(buffer, size);
-    kernel.setCallerReturn(count);
+    finishTransfer(fc, count, fc->getReadWaiters());
 }
 
 void kernel::syscall_write(int fd, const void *buffer, unsigned long size)
@@ -261,7 +498,8 @@ void kernel::syscall_write(int fd, const void *buffer, unsigned long size)
         kernel.setCallerReturn(ENOFILE);
         return;
     }
-    kernel.setCallerReturn(fc->write(buffer, size));
+    int count = fc->write(buffer, size);
+    finishTransfer(fc, count, fc->getWriteWaiters());
 }
 
 void kernel::syscall_fddup(int oldfd, int newfd)
@@ -316,14 +554,46 @@ void kernel::syscall_create_pipe(int pipefd[2])
         return;
     }
 
-    pipefd[0] = kernel.getActiveProcess()->storeFileContext(reader);
-    pipefd[1] = kernel.getActiveProcess()->storeFileContext(writer);
-    kernel.setCallerReturn(ENONE);
+    int fds[2];
+    fds[0] = kernel.getActiveProcess()->storeFileContext(reader);
+    fds[1] = kernel.getActiveProcess()->storeFileContext(writer);
+    kernel.setCallerReturn(memory::copy_to_user(pipefd, fds, sizeof(fds)));
+}
+
+void kernel::syscall_fork()
+{
+    using namespace kernel::sched;
+    using namespace kernel::memory;
+    AddressSpace *addressSpace = cloneAddressSpace();
+    if (addressSpace == nullptr)
+    {
+        kernel.setCallerReturn(ENOMEM);
+        return;
+    }
+
+    pid_t pid = kernel.nextPid();
+    Process *newProcess = kernel.getActiveProcess()->fork(pid, addressSpace);
+    if (newProcess == nullptr)
+    {
+        destoryAddressSpace(*addressSpace);
+        delete addressSpace;
+        kernel.setCallerReturn(ENOMEM);
+        return;
+    }
+
+    kernel.addProcess(newProcess);
+    kernel.setCallerReturn(pid);
 }
 
 kernel::Kernel::Kernel()
-    : scheduler(), processTable(), fs(nullptr), currPid(1)
+    : lock(), processTable(), fs(nullptr), currPid(1), clock(nullptr), sliceTimer(nullptr), mailbox(nullptr)
 {
+    for (int i = 0; i < sched::maxCpus; i++)
+    {
+        runningSince[i] = 0;
+        idling[i] = false;
+        idleStacks[i] = nullptr;
+    }
 }
 
 pid_t kernel::Kernel::nextPid()
@@ -333,18 +603,25 @@ pid_t kernel::Kernel::nextPid()
     return v;
 }
 
-int kernel::Kernel::initMemory(memory::MemoryMap &memoryMap, unsigned long kernelSize)
+int kernel::Kernel::initMemory(memory::MemoryMap &memoryMap, void *pageMap, unsigned long kernelSize)
 {
     using namespace memory;
-    kernelLog(LogLevel::DEBUG, "Constructing page allocator at %016x", &__end);
-    new (&pageAllocator) memory::PageAllocator(memoryMap, &__end, page_size);
-    unsigned long pageMapEnd = (unsigned long)&__end + PageAllocator::mapSize(memoryMap, page_size);
+    unsigned long pageMapEnd = (unsigned long)pageMap + PageAllocator::mapSize(memoryMap, page_size);
     pageMapEnd = (pageMapEnd + (page_size - 1)) & ~(page_size - 1);
-    unsigned long heapSize = ((unsigned long)&__high_mem + kernelSize) - pageMapEnd;
+    unsigned long kernelEnd = (unsigned long)&__high_mem + kernelSize;
+    if (pageMapEnd >= kernelEnd)
+    {
+        kernelLog(LogLevel::PANIC, "Page allocator block map does not fit in the kernel's initial mapping");
+        return ENOMEM;
+    }
+
+    kernelLog(LogLevel::DEBUG, "Constructing page allocator at %016x", pageMap);
+    new (&pageAllocator) memory::PageAllocator(memoryMap, pageMap, page_size);
+    unsigned long heapSize = kernelEnd - pageMapEnd;
 
     kernelLog(LogLevel::DEBUG, "Constructing kernel heap at %016x with size %016x", pageMapEnd, heapSize);
-    init_heap((void *)pageMapEnd, heapSize);
-    return 0;
+    init_heap((void *)pageMapEnd, heapSize, heapReserveSize);
+    return ENONE;
 }
 
 int kernel::Kernel::initRamFS(void *ramfs)
@@ -364,42 +641,208 @@ FAT32 *kernel::Kernel::getRamFS()
     return fs;
 }
 
+void kernel::Kernel::setClock(devices::SystemTimer *clock)
+{
+    this->clock = clock;
+}
+
+kernel::devices::SystemTimer *kernel::Kernel::getClock()
+{
+    return clock;
+}
+
+void kernel::Kernel::setCoreDevices(devices::CoreTimer *sliceTimer, devices::CoreMailbox *mailbox)
+{
+    this->sliceTimer = sliceTimer;
+    this->mailbox = mailbox;
+}
+
+int kernel::Kernel::initIdleStacks()
+{
+    for (int i = 0; i < sched::maxCpus; i++)
+    {
+        if (idleStacks[i] == nullptr && (idleStacks[i] = memory::kernelStacks.allocate()) == nullptr)
+        {
+            return ENOMEM;
+        }
+    }
+    return ENONE;
+}
+
+void *kernel::Kernel::getIdleStack(int cpu)
+{
+    return idleStacks[cpu];
+}
+
+void kernel::Kernel::enterKernel(sched::Context *ctx)
+{
+    lock.acquire();
+    if (ctx != nullptr && getActiveProcess() != nullptr)
+    {
+        getActiveProcess()->storeContext(ctx);
+    }
+}
+
+kernel::sched::Context *kernel::Kernel::leaveKernel()
+{
+    // A signal that kills the process switches to another, which may have
+    // signals of its own
+    sched::Process *process = nullptr;
+    while (process != getActiveProcess())
+    {
+        process = getActiveProcess();
+        raisePostedSignals(process);
+    }
+    return getActiveProcess()->getContext();
+}
+
 void kernel::Kernel::switchTask()
 {
-    scheduler.sched_next();
-    memory::loadAddressSpace(*scheduler.get_cur_process()->getAddressSpace());
+    chargeActiveProcess();
+    // Clear a few pages for later page faults while nothing else is running
+    memory::pageAllocator.refillZeroed(zeroedRefillBudget);
+    if (!pickNext())
+    {
+        // This may be the kernel stack of a process another processor
+        // resumes as soon as the kernel is unlocked, so wait elsewhere
+        sched::call_on_stack(idleStacks[sched::currentCpu()], runIdle);
+    }
+    startActiveProcess();
     // kernelLog(LogLevel::DEBUG, "Switched to pid %i", getActiveProcess()->getPid());
 }
 
+void kernel::Kernel::idle()
+{
+    using namespace interrupt;
+    int cpu = sched::currentCpu();
+    while (!pickNext())
+    {
+        // Wait until an interrupt handler (such as a sleeper's timer) makes
+        // something ready, or another processor has work to hand over
+        idling[cpu] = true;
+        lock.release();
+        int source = Interrupts::waitForInterrupt();
+        lock.acquire();
+        idling[cpu] = false;
+        if (source >= 0)
+        {
+            Interrupts::callHandler(source);
+        }
+        memory::pageAllocator.refillZeroed(zeroedRefillBudget);
+    }
+    startActiveProcess();
+    sched::load_context(leaveKernel());
+    while (true)
+    {
+    }
+}
+
+void kernel::Kernel::checkPreemption()
+{
+    chargeActiveProcess();
+    if (runQueue().preempt_pending())
+    {
+        switchTask();
+    }
+}
+
 void kernel::Kernel::setCallerReturn(unsigned long v)
 {
-    scheduler.get_cur_process()->getContext()->setReturnValue(v);
+    runQueue().get_cur_process()->getContext()->setReturnValue(v);
 }
 
-void kernel::Kernel::addProcess(sched::Process &p)
+void kernel::Kernel::addProcess(sched::Process *p)
 {
     using namespace sched;
-    processTable.insert(p.getPid(), p);
-    if (p.getState() == Process::State::ACTIVE)
+    processTable.insert(p->getPid(), p);
+    if (p->getState() == Process::State::ACTIVE)
     {
-        scheduler.enqueue(&processTable.get(p.getPid()));
+        makeReady(p);
     }
 }
 
 kernel::sched::Process *kernel::Kernel::getActiveProcess()
 {
-    return scheduler.get_cur_process();
+    return runQueue().get_cur_process();
+}
+
+kernel::sched::Process *kernel::Kernel::getProcess(pid_t pid)
+{
+    if (!processTable.contains(pid))
+    {
+        return nullptr;
+    }
+    return processTable.get(pid);
+}
+
+void kernel::Kernel::setPriority(sched::Process *process, int priority)
+{
+    for (int i = 0; i < sched::maxCpus; i++)
+    {
+        if (schedulers[i].remove(process))
+        {
+            process->setPriority(priority);
+            schedulers[i].enqueue(process);
+            return;
+        }
+    }
+    process->setPriority(priority);
 }
 
 void kernel::Kernel::sleepActiveProcess()
 {
-    scheduler.set_cur_process(nullptr);
+    chargeActiveProcess();
+    sched::Process *process = getActiveProcess();
+    runQueue().set_cur_process(nullptr);
+    // Signals posted while it ran can interrupt the wait now that it has
+    // stopped
+    raisePostedSignals(process);
+}
+
+int kernel::Kernel::sleepUntil(unsigned long deadline)
+{
+    using namespace sched;
+    Process *process = getActiveProcess();
+    Timer *timer = process->getSleepTimer();
+    timer->callback = wakeSleeper;
+    timer->data = process;
+    // The state is set first because a deadline that has already passed
+    // wakes the process from inside add()
+    process->suspend(Process::State::SLEEPING);
+    int status = clock->add(timer, deadline, timerSlack);
+    if (status != ENONE)
+    {
+        process->resume();
+        return status;
+    }
+    sleepActiveProcess();
+    switchTask();
+    return ENONE;
+}
+
+void kernel::Kernel::block(sched::WaitQueue &queue)
+{
+    using namespace sched;
+    Process *process = getActiveProcess();
+    process->getContext()->restartSyscall();
+    process->suspend(Process::State::BLOCKED);
+    queue.add(process);
+    sleepActiveProcess();
+    switchTask();
+}
+
+void kernel::Kernel::wake(sched::Process *process)
+{
+    process->resume();
+    makeReady(process);
 }
 
 void kernel::Kernel::deleteActiveProcess()
 {
-    processTable.remove(scheduler.get_cur_process()->getPid());
-    scheduler.set_cur_process(nullptr);
+    sched::Process *p = runQueue().get_cur_process();
+    processTable.remove(p->getPid());
+    runQueue().set_cur_process(nullptr);
+    delete p;
 }
 
 int kernel::Kernel::raiseSignal(pid_t pid, int signal)
@@ -410,36 +853,187 @@ int kernel::Kernel::raiseSignal(pid_t pid, int signal)
         kernelLog(LogLevel::WARNING, "Attempt to raise signal %i on non-existent pid %i", signal, pid);
         return -1;
     }
-    else if (processTable.get(pid).getState() != Process::State::ACTIVE && processTable.get(pid).getState() != Process::State::SIGWAIT)
+    Process *process = processTable.get(pid);
+    int cpu = runningOn(process);
+    if (cpu >= 0 && cpu != sched::currentCpu())
+    {
+        // Its registers are live on the other processor, which raises the
+        // signal on its way back to the process
+        process->postSignal(signal);
+        mailbox->send(cpu);
+        return 0;
+    }
+    if (process->getState() == Process::State::BLOCKED)
+    {
+        // Interrupt the wait; the blocked call is made again once any
+        // handler returns
+        process->getWaitQueue()->remove(process);
+        wake(process);
+    }
+    else if (process->getState() == Process::State::SLEEPING)
+    {
+        // Cut the sleep short; nanosleep returns early once any handler
+        // returns
+        clock->cancel(process->getSleepTimer());
+        process->getContext()->setReturnValue(EINTR);
+        wake(process);
+    }
+    if (process->getState() != Process::State::ACTIVE && process->getState() != Process::State::SIGWAIT)
     {
         kernelLog(LogLevel::WARNING, "Process %i cannot acccept signal: invalid state.", pid);
         return -1;
     }
 
-    bool schedule = processTable.get(pid).getState() == Process::State::SIGWAIT;
-    int status = processTable.get(pid).signalTrigger(signal);
+    bool schedule = process->getState() == Process::State::SIGWAIT;
+    int status = process->signalTrigger(signal);
     if (status > 0)
     {
         kernelLog(LogLevel::DEBUG, "Killing process %i due to signal.", pid);
-        if (processTable.get(pid).getState() == Process::State::ACTIVE)
+        if (process == getActiveProcess())
         {
-            scheduler.remove(pid);
-            if (getActiveProcess()->getPid() == pid)
+            deleteActiveProcess();
+            switchTask();
+        }
+        else
+        {
+            for (int i = 0; i < sched::maxCpus; i++)
             {
-                scheduler.set_cur_process(nullptr);
-                switchTask();
+                schedulers[i].remove(process);
             }
+            processTable.remove(pid);
+            delete process;
         }
-        processTable.remove(pid);
     }
     else if (status == 0 && schedule)
     {
         // kernelLog(LogLevel::DEBUG, "Placing process %i back on schedule queue.", pid);
-        scheduler.enqueue(&processTable.get(pid));
+        makeReady(process);
     }
     return status;
 }
 
+unsigned long kernel::Kernel::now()
+{
+    return clock == nullptr ? 0 : clock->now();
+}
+
+void kernel::Kernel::raisePostedSignals(sched::Process *process)
+{
+    int signal;
+    while ((signal = process->takePendingSignal()) >= 0)
+    {
+        if (raiseSignal(process->getPid(), signal) > 0)
+        {
+            return;
+        }
+    }
+}
+
+queue &kernel::Kernel::runQueue()
+{
+    return schedulers[sched::currentCpu()];
+}
+
+int kernel::Kernel::runningOn(sched::Process *process)
+{
+    for (int i = 0; i < sched::maxCpus; i++)
+    {
+        if (schedulers[i].get_cur_process() == process)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool kernel::Kernel::pickNext()
+{
+    if (runQueue().sched_next() != nullptr)
+    {
+        return true;
+    }
+    sched::Process *process = steal();
+    if (process == nullptr)
+    {
+        return false;
+    }
+    runQueue().enqueue(process);
+    return runQueue().sched_next() != nullptr;
+}
+
+kernel::sched::Process *kernel::Kernel::steal()
+{
+    queue *busiest = nullptr;
+    for (int i = 0; i < sched::maxCpus; i++)
+    {
+        if (i != sched::currentCpu() && !schedulers[i].empty() && (busiest == nullptr || schedulers[i].size() > busiest->size()))
+        {
+            busiest = &schedulers[i];
+        }
+    }
+    return busiest == nullptr ? nullptr : busiest->dequeue();
+}
+
+void kernel::Kernel::startActiveProcess()
+{
+    memory::loadAddressSpace(*getActiveProcess()->getAddressSpace());
+    runningSince[sched::currentCpu()] = now();
+    armSliceTimer();
+}
+
+void kernel::Kernel::chargeActiveProcess()
+{
+    if (getActiveProcess() == nullptr)
+    {
+        return;
+    }
+    int cpu = sched::currentCpu();
+    unsigned long time = now();
+    runQueue().charge(time - runningSince[cpu]);
+    runningSince[cpu] = time;
+}
+
+void kernel::Kernel::makeReady(sched::Process *process)
+{
+    runQueue().enqueue(process);
+    if (getActiveProcess() == nullptr)
+    {
+        // This processor is idle, and picks the process up itself
+        return;
+    }
+    for (int i = 0; i < sched::maxCpus; i++)
+    {
+        if (idling[i] && mailbox != nullptr)
+        {
+            mailbox->send(i);
+            break;
+        }
+    }
+    if (sliceTimer != nullptr && !sliceTimer->isArmed())
+    {
+        armSliceTimer();
+    }
+}
+
+void kernel::Kernel::armSliceTimer()
+{
+    if (sliceTimer == nullptr)
+    {
+        return;
+    }
+    sched::Process *process = getActiveProcess();
+    if (process != nullptr && !runQueue().empty())
+    {
+        unsigned long elapsed = now() - runningSince[sched::currentCpu()];
+        unsigned long timeslice = process->getTimeslice();
+        sliceTimer->arm(elapsed >= timeslice ? 0 : timeslice - elapsed);
+    }
+    else
+    {
+        sliceTimer->disarm();
+    }
+}
+
 int kernel::Kernel::exec(const char *path, char *const argv[], char *const envp[])
 {
     using namespace memory;
@@ -462,36 +1056,58 @@ int kernel::Kernel::exec(const char *path, char *const argv[], char *const envp[
         return ENOFILE;
     }
 
-    void *exeData = rmalloc(size);
-    for (int i = 0; i < size; i += 512)
+    ELF *exe = new ELF(*fs, path, size);
+    if (exe == nullptr)
     {
-        byte *data;
-        if (fs->read_file(path, i / 512, data) == failure)
-        {
-            kernelLog(LogLevel::WARNING, "kernel.exec() failure: I/O error.");
-            return EIO;
-        }
-        memcpy((char *)exeData + i, data, size - i >= 512 ? 512 : size - i);
-        delete data;
-        data = nullptr;
+        return ENOMEM;
+    }
+    else if (type != File || !exe->isValid())
+    {
+        kernelLog(LogLevel::INFO, "kernel.exec() failure: %s is not an executable.", path);
+        delete exe;
+        return EINVAL;
     }
 
     AddressSpace *addressSpace = createAddressSpace();
+    if (addressSpace == nullptr)
+    {
+        delete exe;
+        return ENOMEM;
+    }
     loadAddressSpace(*addressSpace);
 
-    ELF exe(exeData);
-    buildProgramImage(exe);
+    // The image's regions hold their own references to the binary
+    void *entry = exe->fileHeader().entry;
+    exe->addReference();
+    int status = buildProgramImage(*exe, *addressSpace);
+    exe->removeReference();
+    if (exe->getRefCount() <= 0)
+    {
+        delete exe;
+    }
+    if (status != 0)
+    {
+        kernelLog(LogLevel::WARNING, "kernel.exec() failure: could not load %s.", path);
+        abandonAddressSpace(addressSpace, getActiveProcess()->getAddressSpace());
+        return EIO;
+    }
+
+    if (addressSpace->addRegion((void *)0x7FBFFF0000, 0x10000, PAGE_USER | PAGE_RW, AddressSpace::Region::Type::ANONYMOUS) != ENONE)
+    {
+        abandonAddressSpace(addressSpace, getActiveProcess()->getAddressSpace());
+        return ENOMEM;
+    }
 
-    map_region((void *)0x7FBFFF0000, 0x10000, pageAllocator.reserve(0x10000), PAGE_USER | PAGE_RW);
-    void *base = rmalloc(1UL << 16);
-    if (base == nullptr)
+    // A process keeps its kernel stack across exec; only the first process
+    // starts without one
+    void *kernelStack = getActiveProcess()->getContext()->getKernelStack();
+    if (kernelStack == nullptr && (kernelStack = kernelStacks.allocate()) == nullptr)
     {
-        rfree(exeData);
+        abandonAddressSpace(addressSpace, getActiveProcess()->getAddressSpace());
         return ENOMEM;
     }
-    void *kernelStack = (void *)((unsigned long)base + (1UL << 16));
 
-    getActiveProcess()->exec(exe.fileHeader().entry, (void *)0x7FC0000000, kernelStack, addressSpace);
+    getActiveProcess()->exec(entry, (void *)0x7FC0000000, kernelStack, addressSpace);
     getActiveProcess()->storeProgramArgs(argv, envp);
 
     if (getActiveProcess()->getFileContext(0) == nullptr)
@@ -542,6 +1158,145 @@ int kernel::Kernel::exec(const char *path, char *const argv[], char *const envp[
         }
     }
 
-    rfree(exeData);
     return ENONE;
 }
+
+void kernel::syscall_shm_create(unsigned long size)
+{
+    using namespace kernel::fs;
+    using namespace kernel::memory;
+    if (size == 0)
+    {
+        kernel.setCallerReturn(EINVAL);
+        return;
+    }
+
+    SharedMemory *segment = SharedMemory::create(size);
+    if (segment == nullptr)
+    {
+        kernel.setCallerReturn(ENOMEM);
+        return;
+    }
+
+    FileContext *fc = segment->createContext();
+    if (fc == nullptr)
+    {
+        delete segment;
+        kernel.setCallerReturn(ENOMEM);
+        return;
+    }
+    kernel.setCallerReturn(kernel.getActiveProcess()->storeFileContext(fc));
+}
+
+void kernel::syscall_shm_map(int fd, void *ptr, int flags)
+{
+    using namespace kernel::fs;
+    FileContext *fc = kernel.getActiveProcess()->getFileContext(fd);
+    if (fc == nullptr)
+    {
+        kernel.setCallerReturn(EINVAL);
+        return;
+    }
+
+    int status = fc->map(ptr, 0, 0, flags);
+    kernel.setCallerReturn(status == ENOSYS ? EINVAL : status);
+}
+
+void kernel::syscall_meminfo(pid_t pid, meminfo_t *info)
+{
+    using namespace kernel::memory;
+    sched::Process *process = pid == 0 ? kernel.getActiveProcess() : kernel.getProcess(pid);
+    if (info == nullptr || process == nullptr || process->getAddressSpace() == nullptr)
+    {
+        kernel.setCallerReturn(EINVAL);
+        return;
+    }
+
+    meminfo_t result;
+    result.total_pages = pageAllocator.getTotalPages();
+    result.free_pages = pageAllocator.getFreePages();
+    result.zeroed_pages = pageAllocator.getZeroedPages();
+    pageAllocator.getFreeBlocks(result.free_blocks, MEMINFO_ORDERS);
+    heap_info(&result.heap_used, &result.heap_free, &result.heap_largest_free);
+    countResidentPages(*process->getAddressSpace(), result.resident_pages, result.shared_pages);
+    kernel.setCallerReturn(copy_to_user(info, &result, sizeof(result)));
+}
+
+void kernel::syscall_mmap_file(int fd, unsigned long offset, unsigned long size, int flags)
+{
+    using namespace kernel::fs;
+    using namespace kernel::memory;
+    FileContext *fc = kernel.getActiveProcess()->getFileContext(fd);
+    AddressSpace *addressSpace = kernel.getActiveProcess()->getAddressSpace();
+    if (fc == nullptr)
+    {
+        kernel.setCallerReturn(ENOFILE);
+        return;
+    }
+    else if (size == 0 || size > mmapBase)
+    {
+        kernel.setCallerReturn(EINVAL);
+        return;
+    }
+
+    void *ptr = findFreeRange(*addressSpace, (size + page_size - 1) & ~(page_size - 1));
+    if (ptr == nullptr)
+    {
+        kernel.setCallerReturn(ENOMEM);
+        return;
+    }
+
+    int status = fc->map(ptr, offset, size, flags);
+    if (status == ENOSYS)
+    {
+        status = EINVAL;
+    }
+    kernel.setCallerReturn(status == ENONE ? (unsigned long)ptr : status);
+}
+
+void kernel::syscall_setpriority(pid_t pid, int priority)
+{
+    using namespace kernel::sched;
+    Process *process = pid == 0 ? kernel.getActiveProcess() : kernel.getProcess(pid);
+    if (process == nullptr || priority < PRIORITY_MIN || priority > PRIORITY_MAX)
+    {
+        kernel.setCallerReturn(EINVAL);
+        return;
+    }
+    kernel.setPriority(process, priority);
+    kernel.setCallerReturn(ENONE);
+}
+
+void kernel::syscall_nanosleep(unsigned long nanoseconds)
+{
+    kernel.setCallerReturn(ENONE);
+    if (nanoseconds == 0)
+    {
+        return;
+    }
+    // Round up, so the process never wakes before the time asked for
+    unsigned long microseconds = nanoseconds / 1000 + (nanoseconds % 1000 != 0);
+    int status = kernel.sleepUntil(kernel.getClock()->now() + microseconds);
+    if (status != ENONE)
+    {
+        kernel.setCallerReturn(status);
+    }
+}
+
+void kernel::syscall_setflags(int fd, int flags)
+{
+    using namespace kernel::fs;
+    FileContext *fc = kernel.getActiveProcess()->getFileContext(fd);
+    if (fc == nullptr)
+    {
+        kernel.setCallerReturn(ENOFILE);
+        return;
+    }
+    if ((flags & ~FILE_NONBLOCK) != 0)
+    {
+        kernel.setCallerReturn(EINVAL);
+        return;
+    }
+    fc->setFlags(flags);
+    kernel.setCallerReturn(ENONE);
+}
@@ -4,8 +4,14 @@
 #include "memory/memorymap.h"
 #include "fs/fat32/fat32.h"
 #include "sched/queue.h"
+#include "devices/timer.h"
+#include "devices/coretimer.h"
+#include "devices/coremailbox.h"
+#include "sched/cpu.h"
+#include "util/bakerylock.h"
 #include "containers/binary_search_tree.h"
 #include "types/pid.h"
+#include "types/meminfo.h"
 
 /**
  * @brief Symbol located at the beginning of the kernel binary in memory.
@@ -26,11 +32,23 @@ extern "C" void (*syscall_table[])(long, long, long, long);
 
 extern "C" kernel::sched::Context *do_syscall(unsigned long id, unsigned long arg1, unsigned long arg2, unsigned long arg3, unsigned long arg4, kernel::sched::Context *ctx);
 
+/**
+ * @brief Unlocks the kernel. Called by `load_context` once it no longer
+ * needs the kernel stack it was called on.
+ */
+extern "C" void kernel_lock_release();
+
 namespace kernel
 {
 
     void initialize(memory::MemoryMap &memoryMap, unsigned long kernelSize);
 
+    /**
+     * @brief The kernel proper. Every processor runs the same kernel, one at
+     * a time: a processor locks it on entry from a process (see
+     * `enterKernel()`), and `load_context` unlocks it on the way out.
+     * Processors wait for interrupts with the kernel unlocked.
+     */
     class Kernel
     {
     public:
@@ -38,24 +56,145 @@ namespace kernel
 
         pid_t nextPid();
 
-        int initMemory(memory::MemoryMap &memoryMap, unsigned long kernelSize);
+        /**
+         * @brief Builds the page allocator and kernel heap. The allocator's
+         * block map is placed at `pageMap`, and the heap fills the rest of
+         * the kernel's initial mapping after it.
+         *
+         * @param memoryMap layout of physical memory
+         * @param pageMap page-aligned location for the block map, inside the
+         * kernel's initial mapping
+         * @param kernelSize size of the kernel's initial mapping
+         * @return ENONE, or ENOMEM if the block map leaves no room for a heap
+         */
+        int initMemory(memory::MemoryMap &memoryMap, void *pageMap, unsigned long kernelSize);
 
         int initRamFS(void *ramfs);
 
         FAT32 *getRamFS();
 
+        /**
+         * @brief Sets the clock used for timeslices and sleeping. Must be
+         * called before the first task switch.
+         */
+        void setClock(devices::SystemTimer *clock);
+
+        devices::SystemTimer *getClock();
+
+        /**
+         * @brief Sets the per-processor devices used to preempt processes
+         * and to interrupt other processors. Must be called before the first
+         * task switch.
+         */
+        void setCoreDevices(devices::CoreTimer *sliceTimer, devices::CoreMailbox *mailbox);
+
+        /**
+         * @brief Reserves a stack for each processor to idle on.
+         * @return ENONE, or ENOMEM
+         */
+        int initIdleStacks();
+
+        /**
+         * @return the top of the idle stack of processor `cpu`
+         */
+        void *getIdleStack(int cpu);
+
+        /**
+         * @brief Locks the kernel for the calling processor, and saves `ctx`
+         * as the context of the process it was running, if any.
+         */
+        void enterKernel(sched::Context *ctx);
+
+        /**
+         * @brief Raises any signals other processors posted for the active
+         * process, which may switch tasks, then returns the context to pass
+         * to `load_context`.
+         */
+        sched::Context *leaveKernel();
+
+        /**
+         * @brief Switches to the next process to run, taking one from
+         * another processor if this one has none ready. If there is nothing
+         * to run anywhere, this does not return: the processor idles, and
+         * resumes the next process it finds directly.
+         */
         void switchTask();
 
+        /**
+         * @brief Waits with the kernel unlocked until there is a process to
+         * run, then resumes it. Only entered through `switchTask()`, on the
+         * processor's idle stack.
+         */
+        [[noreturn]] void idle();
+
+        friend void ::kernel_lock_release();
+
+        /**
+         * @brief Charges the running process for the time since it was
+         * last charged, and switches tasks if it has used up its timeslice
+         * or a process of higher priority is ready.
+         */
+        void checkPreemption();
+
         void setCallerReturn(unsigned long v);
 
-        void addProcess(sched::Process &p);
+        /**
+         * @brief Adds `p` to the process table, which takes ownership of it,
+         * and schedules it if it is active.
+         */
+        void addProcess(sched::Process *p);
 
         sched::Process *getActiveProcess();
 
+        /**
+         * @return the process with the given pid, or nullptr if there is none
+         */
+        sched::Process *getProcess(pid_t pid);
+
+        /**
+         * @brief Changes the priority of `process`, moving it to the right
+         * run queue if it is waiting to run.
+         */
+        void setPriority(sched::Process *process, int priority);
+
         void sleepActiveProcess();
 
+        /**
+         * @brief Puts the active process to sleep until `deadline` on the
+         * clock, then switches tasks.
+         * @return ENONE, or ENOMEM if no timer could be armed, in which case
+         * the process keeps running
+         */
+        int sleepUntil(unsigned long deadline);
+
+        /**
+         * @brief Blocks the active process on `queue` and switches tasks.
+         * The process's system call is made again once it is woken, so the
+         * caller must return without setting a return value.
+         */
+        void block(sched::WaitQueue &queue);
+
+        /**
+         * @brief Returns a SLEEPING or BLOCKED process to the state it was
+         * in before, and schedules it. The caller must already have taken it
+         * off any wait queue.
+         */
+        void wake(sched::Process *process);
+
+        /**
+         * @brief Removes the active process from the process table and frees
+         * it. The caller keeps running on its kernel stack until the next
+         * task switch, which the kernel stays locked for.
+         */
         void deleteActiveProcess();
 
+        /**
+         * @brief Raises `signal` on process `pid`. A process running on
+         * another processor has the signal posted to it instead, and that
+         * processor is interrupted to raise it.
+         * @return a negative value if the signal could not be raised, 1 if
+         * the process was killed, otherwise 0
+         */
         int raiseSignal(pid_t pid, int signal);
 
         int exec(const char *path, char *const argv[], char *const envp[]);
@@ -63,13 +202,99 @@ namespace kernel
         void loadInitProgram();
 
     private:
-        queue scheduler;
+        BakeryLock lock;
 
-        binary_search_tree<pid_t, sched::Process> processTable;
+        /**
+         * @brief Run queue of each processor, which also tracks the process
+         * running on it
+         */
+        queue schedulers[sched::maxCpus];
+
+        /**
+         * @brief Every process, by pid. The table owns the processes; it
+         * stores pointers because the tree moves its values around.
+         */
+        binary_search_tree<pid_t, sched::Process *> processTable;
 
         FAT32 *fs;
 
         pid_t currPid;
+
+        devices::SystemTimer *clock;
+
+        /**
+         * @brief Fires when the running process's timeslice runs out. Only
+         * armed while other processes are ready, so a lone process runs
+         * without interruption.
+         */
+        devices::CoreTimer *sliceTimer;
+
+        devices::CoreMailbox *mailbox;
+
+        /**
+         * @brief Time each processor's running process was last charged for
+         */
+        unsigned long runningSince[sched::maxCpus];
+
+        /**
+         * @brief Set while a processor waits in `idle()`
+         */
+        bool idling[sched::maxCpus];
+
+        void *idleStacks[sched::maxCpus];
+
+        unsigned long now();
+
+        /**
+         * @return the calling processor's run queue
+         */
+        queue &runQueue();
+
+        /**
+         * @return the processor running `process`, or -1 if it is not
+         * running
+         */
+        int runningOn(sched::Process *process);
+
+        /**
+         * @brief Makes the calling processor's next process the active one,
+         * taking one from another processor if it has none ready.
+         * @return true if there is an active process
+         */
+        bool pickNext();
+
+        /**
+         * @brief Raises the signals posted to `process` by other processors,
+         * stopping early if one kills it
+         */
+        void raisePostedSignals(sched::Process *process);
+
+        /**
+         * @brief Takes the first process from the longest run queue of any
+         * other processor.
+         * @return the process, or nullptr if the others have none ready
+         */
+        sched::Process *steal();
+
+        /**
+         * @brief Loads the active process's address space and starts its
+         * timeslice
+         */
+        void startActiveProcess();
+
+        /**
+         * @brief Charges the running process for the time it has run
+         */
+        void chargeActiveProcess();
+
+        /**
+         * @brief Adds `process` to the calling processor's run queue, and
+         * interrupts an idle processor to take it if this one is busy. Arms
+         * the slice timer if the process has to share the processor.
+         */
+        void makeReady(sched::Process *process);
+
+        void armSliceTimer();
     };
 
     extern Kernel kernel;
@@ -82,11 +307,14 @@ namespace kernel
     void syscall_printk(const char *str);
 
     /**
-     * @brief Map a region in memory to newly allocated page frames
-     * @param ptr Pointer to the start of the region to map
+     * @brief Reserve a region of zero-filled memory. Page frames are only
+     * allocated when each page is first written; until then, reads are
+     * satisfied by a shared zero page.
+     * @param ptr Pointer to the start of the region to map (page-aligned)
      * @param size Size in bytes of the region to map
      * @param flags Access flags for the pages to map
-     * @return
+     * @return ENONE, EINVAL if the region is misaligned or outside user
+     * memory, or EEXISTS if it overlaps an existing region
      */
     void syscall_mmap(void *ptr, unsigned long size, int flags);
 
@@ -94,7 +322,8 @@ namespace kernel
      * @brief Free the memory in a particular region
      * @param ptr Pointer to the start of the region to unmap
      * @param size Size in bytes of the region to unmap
-     * @return
+     * @return ENONE, EINVAL if the region is misaligned, empty or outside
+     * user memory, or ENOMEM if no memory was available to split a mapping
      */
     void syscall_munmap(void *ptr, unsigned long size);
 
@@ -229,6 +458,88 @@ namespace kernel
      * @brief Creates a new pipe.
      */
     void syscall_create_pipe(int pipefd[2]);
+
+    /**
+     * @brief Create a new process with a copy-on-write duplicate of the
+     * current process's address space, file descriptors and signal handlers.
+     * The child resumes at the same point with a return value of 0.
+     * @return pid of the new process, or ENOMEM
+     */
+    void syscall_fork();
+
+    /**
+     * @brief Creates a shared memory segment of `size` bytes (rounded up to
+     * whole pages), filled with zeroes. The segment is freed once every
+     * descriptor referring to it is closed and every mapping of it removed.
+     * @param size
+     * @return a file descriptor referring to the segment, EINVAL if `size` is
+     * 0, or ENOMEM
+     */
+    void syscall_shm_create(unsigned long size);
+
+    /**
+     * @brief Maps the whole of a shared memory segment at `ptr`. The same
+     * frames back every mapping of the segment, in any process, and they
+     * stay shared across fork. Unmap with `munmap`.
+     * @param fd descriptor returned by `shm_create`
+     * @param ptr page-aligned address to map the segment at
+     * @param flags access flags for the mapped pages
+     * @return ENONE, EINVAL if `fd` does not refer to a segment or the range
+     * is misaligned or outside user memory, or EEXISTS if it overlaps an
+     * existing region
+     */
+    void syscall_shm_map(int fd, void *ptr, int flags);
+
+    /**
+     * @brief Reports physical memory, kernel heap and per-process memory
+     * usage.
+     * @param pid process whose resident pages to count, or 0 for the caller
+     * @param info structure to fill in
+     * @return ENONE, or EINVAL if `info` is null or there is no such process
+     */
+    void syscall_meminfo(pid_t pid, meminfo_t *info);
+
+    /**
+     * @brief Maps part of an open file at a free address chosen by the
+     * kernel.
+     * @param fd descriptor of the file to map
+     * @param offset page-aligned offset into the file
+     * @param size number of bytes to map
+     * @param flags access flags for the mapped pages
+     * @return the address of the mapping, ENOFILE if `fd` is not open, EINVAL
+     * if the file cannot be mapped or the range is invalid, or ENOMEM
+     */
+    void syscall_mmap_file(int fd, unsigned long offset, unsigned long size, int flags);
+
+    /**
+     * @brief Changes the scheduling priority of a process. Higher priorities
+     * always run first, so raising a process above the caller lets it run
+     * right away.
+     * @param pid process to change, or 0 for the calling process
+     * @param priority new priority, from PRIORITY_MIN to PRIORITY_MAX
+     * @return ENONE, or EINVAL if the priority is out of range or there is no
+     * such process
+     */
+    void syscall_setpriority(pid_t pid, int priority);
+
+    /**
+     * @brief Suspends the calling process for at least `nanoseconds`. The
+     * clock counts whole microseconds, and wakeups may be delayed by a
+     * little slack so they can share an interrupt with other timers.
+     * @param nanoseconds time to sleep for; 0 returns right away
+     * @return ENONE, EINTR if a signal cut the sleep short, or ENOMEM
+     */
+    void syscall_nanosleep(unsigned long nanoseconds);
+
+    /**
+     * @brief Sets the flags of an open file. Descriptors inherited across
+     * fork keep their flags; descriptors made with fddup share them.
+     * @param fd descriptor to change
+     * @param flags flags from `file_flags_t`
+     * @return ENONE, ENOFILE if `fd` is not open, or EINVAL if `flags` has
+     * unknown bits set
+     */
+    void syscall_setflags(int fd, int flags);
 }
 
 #endif
\ No newline at end of file
@@ -5,46 +5,84 @@
 #include "elf.h"
 #include "memory/mmap.h"
 #include "memory/pageallocator.h"
+#include "types/status.h"
 #include "util/string.h"
 
-kernel::loader::ELF::ELF(void *file)
+kernel::loader::ELF::ELF(FAT32 &fs, string path, unsigned long fileSize)
+    : fs(fs), path(path), fileSize(fileSize), programHeaders(nullptr), sectionIndex(0)
 {
-    header = (ELFFileHeader *)file;
-    sectionIndex = 0;
+    if (read(0, &header, sizeof(header)) != ENONE)
+    {
+        header.magic = 0;
+        return;
+    }
+
+    if (header.phcount == 0 || header.phsize != sizeof(ELFProgramHeader))
+    {
+        return;
+    }
+
+    programHeaders = new ELFProgramHeader[header.phcount];
+    if (programHeaders != nullptr && read(header.phoffset, programHeaders, header.phcount * sizeof(ELFProgramHeader)) != ENONE)
+    {
+        delete[] programHeaders;
+        programHeaders = nullptr;
+    }
 }
 
-const void *kernel::loader::ELF::fileLocation() const
+kernel::loader::ELF::~ELF()
 {
-    return (void *)header;
+    delete[] programHeaders;
 }
 
 bool kernel::loader::ELF::isValid() const
 {
-    return header->magic == 0x464c457f && header->phcount > 0;
+    return header.magic == 0x464c457f && header.phcount > 0 && programHeaders != nullptr;
 }
 
 const kernel::loader::ELFFileHeader &kernel::loader::ELF::fileHeader() const
 {
-    return *header;
+    return header;
 }
 
 const kernel::loader::ELFProgramHeader &kernel::loader::ELF::currentSection() const
 {
-    ELFProgramHeader *sectionHeader = (ELFProgramHeader *)((void *)header + header->phoffset);
-    return sectionHeader[sectionIndex];
+    return programHeaders[sectionIndex];
 }
 
 bool kernel::loader::ELF::nextSection()
 {
     sectionIndex++;
-    if (sectionIndex >= header->phcount)
+    if (sectionIndex >= header.phcount)
     {
         sectionIndex = 0;
     }
     return (sectionIndex > 0);
 }
 
-int kernel::loader::buildProgramImage(ELF &elf)
+int kernel::loader::ELF::read(unsigned long offset, void *dest, unsigned long size) const
+{
+    if (offset > fileSize || size > fileSize - offset)
+    {
+        return EIO;
+    }
+
+    // Copy from however many runs of contiguous clusters the range spans
+    byte *location;
+    int length;
+    for (unsigned long pos = 0; pos < size; pos += length)
+    {
+        if (fs.file_extent(path, offset + pos, location, length) == failure || length <= 0)
+        {
+            return EIO;
+        }
+        length = (unsigned long)length < size - pos ? length : size - pos;
+        memcpy(dest + pos, location, length);
+    }
+    return ENONE;
+}
+
+int kernel::loader::buildProgramImage(ELF &elf, memory::AddressSpace &addressSpace)
 {
     using namespace kernel::memory;
 
@@ -54,33 +92,94 @@ int kernel::loader::buildProgramImage(ELF &elf)
         return -1;
     }
 
+    // Last page filled for two segments, in case a third one shares it too
+    unsigned long sharedPage = 0;
+    int sharedFlags = 0;
     do
     {
         // Check if section should be loaded
-        if ((ELFSegmentType)elf.currentSection().type != ELFSegmentType::LOAD)
+        const ELFProgramHeader &segment = elf.currentSection();
+        if ((ELFSegmentType)segment.type != ELFSegmentType::LOAD || segment.memsize == 0)
         {
             continue;
         }
 
-        // Try to allocate enough physical memory
-        unsigned long sectionSize = elf.currentSection().memsize;
-        physaddr_t frame = pageAllocator.reserve(sectionSize);
-        if (frame == PageAllocator::NOMEM)
+        unsigned long vaddr = (unsigned long)segment.vaddr;
+        unsigned long start = vaddr & ~(page_size - 1);
+        if (segment.filesize > segment.memsize || segment.offset < vaddr - start)
         {
             return -1;
         }
 
-        unsigned long fileSize = elf.currentSection().filesize;
-
-        // Map virtual memory, then copy section data
-        void *dest = elf.currentSection().vaddr;
-        const void *src = elf.fileLocation() + elf.currentSection().offset;
-        unsigned long diff = (unsigned long)dest % page_size;
-        void *mapPtr = getPageFrame(dest) == 0 ? (dest - diff) : (dest + (page_size - diff));
-        unsigned long mapSize = getPageFrame(dest) == 0 ? (sectionSize + diff) : (sectionSize - (page_size - diff));
-        map_region(mapPtr, mapSize, frame, PAGE_RW | PAGE_USER | PAGE_EXE);
-        memset(dest, sectionSize, 0);
-        memcpy(dest, src, fileSize);
+        int flags = PAGE_USER;
+        if (segment.flags & PF_W)
+        {
+            flags |= PAGE_RW;
+        }
+        if (segment.flags & PF_X)
+        {
+            flags |= PAGE_EXE;
+        }
+
+        // A first page shared with the previous segment has to hold data
+        // from both, so it is filled now with the permissions of both
+        AddressSpace::Region *previous = addressSpace.findRegion((void *)start);
+        if (previous != nullptr || (sharedPage == start && start != 0))
+        {
+            physaddr_t frame;
+            if (previous != nullptr)
+            {
+                frame = pageAllocator.reserve(page_size);
+                if (frame == PageAllocator::NOMEM)
+                {
+                    return -1;
+                }
+                if (previous->fill((void *)start, physicalToLinear(frame)) != ENONE)
+                {
+                    pageAllocator.release(frame);
+                    return -1;
+                }
+                sharedFlags = previous->flags;
+                addressSpace.removeRegion((void *)start, page_size);
+            }
+            else
+            {
+                frame = getPageFrame((void *)start);
+            }
+
+            void *dest = physicalToLinear(frame);
+            unsigned long length = start + page_size - vaddr < segment.filesize ? start + page_size - vaddr : segment.filesize;
+            if (elf.read(segment.offset, dest + (vaddr - start), length) != ENONE)
+            {
+                return -1;
+            }
+            sharedFlags |= flags;
+            if (sharedFlags & PAGE_EXE)
+            {
+                syncInstructionCache(dest, page_size);
+            }
+            map_region((void *)start, page_size, frame, sharedFlags);
+            sharedPage = start;
+            start += page_size;
+        }
+
+        // Pages holding file data are read in when touched; the remaining
+        // .bss pages are plain demand-zero memory
+        unsigned long dataEnd = (vaddr + segment.filesize + page_size - 1) & ~(page_size - 1);
+        unsigned long end = (vaddr + segment.memsize + page_size - 1) & ~(page_size - 1);
+        if (start < dataEnd)
+        {
+            if (addressSpace.addRegion((void *)start, dataEnd - start, flags, AddressSpace::Region::Type::IMAGE) != ENONE)
+            {
+                return -1;
+            }
+            addressSpace.findRegion((void *)start)->setSource(&elf, segment.offset - (vaddr - start), vaddr + segment.filesize - start);
+        }
+        start = start > dataEnd ? start : dataEnd;
+        if (start < end && addressSpace.addRegion((void *)start, end - start, flags, AddressSpace::Region::Type::ANONYMOUS) != ENONE)
+        {
+            return -1;
+        }
     } while (elf.nextSection());
 
     return 0;
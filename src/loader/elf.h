@@ -5,6 +5,9 @@
 #define KERNEL_ELF_H
 
 #include "types/physaddr.h"
+#include "fs/fat32/fat32.h"
+#include "memory/addressspace.h"
+#include "memory/pagesource.h"
 #include <cstdint>
 
 namespace kernel::loader
@@ -35,6 +38,13 @@ namespace kernel::loader
         DYNAMIC = 2
     };
 
+    enum ELFSegmentFlags
+    {
+        PF_X = (1 << 0),
+        PF_W = (1 << 1),
+        PF_R = (1 << 2)
+    };
+
     class ELFFileHeader
     {
     public:
@@ -88,12 +98,23 @@ namespace kernel::loader
 #endif
     };
 
-    class ELF
+    /**
+     * @brief An ELF binary on the file system. Only the file and program
+     * headers are read up front; segment data stays in the file until it is
+     * copied out with `read`. Program images keep a reference to the binary
+     * to fill their pages from.
+     */
+    class ELF : public memory::PageSource
     {
     public:
-        ELF(void *file);
+        /**
+         * @param fs file system holding the binary
+         * @param path path to the binary
+         * @param fileSize size of the binary in bytes
+         */
+        ELF(FAT32 &fs, string path, unsigned long fileSize);
 
-        const void *fileLocation() const;
+        ~ELF();
 
         bool isValid() const;
 
@@ -103,18 +124,38 @@ namespace kernel::loader
 
         bool nextSection();
 
+        /**
+         * @brief Copies `size` bytes starting at `offset` in the binary to
+         * `dest`, straight out of the file's clusters.
+         * @return ENONE, or EIO if the range is not inside the file
+         */
+        int read(unsigned long offset, void *dest, unsigned long size) const override;
+
     private:
-        ELFFileHeader *header;
+        FAT32 &fs;
+
+        string path;
+
+        unsigned long fileSize;
+
+        ELFFileHeader header;
+
+        ELFProgramHeader *programHeaders;
 
         int sectionIndex;
     };
 
     /**
-     * @brief Creates a program image from the given binary in the current address space.
-     * @param elf Binary to unpack
+     * @brief Creates a program image from the given binary in the current
+     * address space. Each loadable segment becomes a region with the
+     * segment's own permissions: file data is read into pages when they are
+     * first touched, and the rest is demand-zero memory. Only a page shared
+     * by two segments is filled immediately.
+     * @param elf Binary to unpack; the regions created keep a reference to it
+     * @param addressSpace the current address space
      * @return zero upon success, nonzero upon failure
      */
-    int buildProgramImage(ELF &elf);
+    int buildProgramImage(ELF &elf, memory::AddressSpace &addressSpace);
 
 #if defined __i386__
     static const ELFISA HOST_ISA = ELFISA::x86;
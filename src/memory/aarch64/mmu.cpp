@@ -7,6 +7,9 @@
 #include "util/hacf.h"
 #include "kernel.h"
 #include "util/log.h"
+#include "util/string.h"
+#include "types/status.h"
+#include "sched/cpu.h"
 #include <cstdint>
 
 using namespace kernel::memory;
@@ -64,7 +67,17 @@ public:
     /**
      * @brief Significant bits of physical address of next table or page.
      */
-    uint64_t outputAddress : 40;
+    uint64_t outputAddress : 36;
+
+    /**
+     * @brief Must be zero with 48-bit output addresses
+     */
+    uint64_t res0 : 4;
+
+    /**
+     * @brief Hint that this entry is one of a contiguous set
+     */
+    uint64_t contiguous : 1;
 
     /**
      * @brief Privileged execute-never
@@ -72,19 +85,25 @@ public:
     uint64_t pxn : 1;
 
     /**
-     * @brief Execute-never
+     * @brief Unprivileged execute-never
      */
-    uint64_t xn : 1;
+    uint64_t uxn : 1;
 
     /**
-     * @brief Copy-on-write
+     * @brief Copy-on-write (software bit)
      */
     uint64_t cow : 1;
 
+    /**
+     * @brief Frame is deliberately shared between address spaces (see
+     * PAGE_SHARED) (software bit)
+     */
+    uint64_t shared : 1;
+
     /**
      * @brief Free for software use
      */
-    uint64_t reserved : 3;
+    uint64_t reserved : 2;
 
     /**
      * @brief When set, all child tables will be treated as if pxn=1
@@ -92,7 +111,7 @@ public:
     uint64_t pxnTable : 1;
 
     /**
-     * @brief When set, all child tables will be treated as if xn=1
+     * @brief When set, all child tables will be treated as if uxn=1
      */
     uint64_t xnTable : 1;
 
@@ -126,7 +145,8 @@ public:
         present = 1;
         apEL0 = (permissions & PAGE_USER) ? 1 : 0;
         apReadOnly = (permissions & PAGE_RW) ? 0 : 1;
-        xn = (permissions & PAGE_EXE) ? 0 : 1;
+        setExecute(permissions);
+        shared = (permissions & PAGE_SHARED) ? 1 : 0;
         af = 1;
         physicalAddress(frame);
     }
@@ -138,11 +158,40 @@ public:
         type = 1;
         apEL0 = (permissions & PAGE_USER) ? 1 : 0;
         apReadOnly = (permissions & PAGE_RW) ? 0 : 1;
-        xn = (permissions & PAGE_EXE) ? 0 : 1;
+        setExecute(permissions);
+        shared = (permissions & PAGE_SHARED) ? 1 : 0;
         af = 1;
         physicalAddress(frame);
     }
 
+    /**
+     * @brief User pages are never executable by the kernel, and only
+     * executable by processes with PAGE_EXE. Kernel pages are never
+     * executable by processes.
+     */
+    void setExecute(int permissions)
+    {
+        bool exe = (permissions & PAGE_EXE) != 0;
+        if (permissions & PAGE_USER)
+        {
+            pxn = 1;
+            uxn = exe ? 0 : 1;
+        }
+        else
+        {
+            pxn = exe ? 0 : 1;
+            uxn = 1;
+        }
+    }
+
+    /**
+     * @return the PageFlags equivalent to this entry's access permissions
+     */
+    int permissions() const
+    {
+        return (apEL0 ? PAGE_USER : 0) | (apReadOnly ? 0 : PAGE_RW) | ((apEL0 ? uxn : pxn) ? 0 : PAGE_EXE) | (shared ? PAGE_SHARED : 0);
+    }
+
     void physicalAddress(physaddr_t addr)
     {
         outputAddress = addr >> 12;
@@ -154,6 +203,8 @@ public:
     }
 };
 
+static_assert(sizeof(PageTableEntry) == 8, "PageTableEntry must match the 64-bit descriptor layout");
+
 PageTableEntry *const kernelTables[] = {
     (PageTableEntry *)0xFFFFFFFFFFFFF000,
     (PageTableEntry *)0xFFFFFFFFFFE00000,
@@ -166,27 +217,641 @@ PageTableEntry *const userTables[] = {
 
 const unsigned long kernel::memory::page_size = 4096;
 
-void kernel::memory::loadAddressSpace(AddressSpace &addressSpace)
+/**
+ * @brief Offset from the start of high memory of the 1 GiB block which maps
+ * physical memory 1:1. Must match the mapping made in `aarch64_boot`.
+ */
+static const unsigned long physicalWindowOffset = 0x100000000;
+
+using kernel::sched::currentCpu;
+using kernel::sched::maxCpus;
+
+/**
+ * @brief Address space loaded on each processor
+ */
+static AddressSpace *activeAddressSpace[maxCpus];
+
+/**
+ * @brief Number of bits in an ASID (TCR_EL1.AS = 0).
+ */
+static const unsigned long asidBits = 8;
+
+/**
+ * @brief ASIDs are handed out in generations, kept in the bits above the
+ * ASID itself. When the ASID space runs out the generation is bumped and the
+ * whole TLB is flushed once; every address space then gets a fresh ASID the
+ * next time it is loaded.
+ */
+static unsigned long asidGeneration = 1UL << asidBits;
+
+/**
+ * @brief Next unused ASID in the current generation. ASID 0 is never handed
+ * out, so an address space which has never been loaded can't match.
+ */
+static unsigned long nextAsid = 1;
+
+/**
+ * @brief ASIDs of the current generation kept by address spaces that were
+ * loaded on other processors when it began. Those processors go on using
+ * them without reloading, so they must not be handed out again.
+ */
+static unsigned long reservedAsids[(1UL << asidBits) / 64];
+
+/**
+ * @brief Top-level table of an address space destroyed while it was still
+ * loaded on some processors, and a bit for each of them. The table is
+ * reclaimed once all of them have loaded another address space. A processor
+ * has at most one such table, so there is never more than one per processor.
+ */
+struct DeferredTeardown
 {
-    unsigned long ttbr0 = addressSpace.getTableFrame() | ((unsigned long)addressSpace.getId() << 48);
-    set_ttbr0_el1(ttbr0);
+    physaddr_t topFrame;
+    unsigned long cpus;
+};
+
+static DeferredTeardown deferredTeardown[maxCpus];
+
+/**
+ * @brief Number of table frames collected before handing them back to the
+ * page allocator during teardown.
+ */
+static const unsigned long teardownBatchSize = 32;
+
+/**
+ * @brief Nesting depth of `beginTLBBatch()`. While non-zero, invalidations
+ * are issued without waiting for them to complete.
+ */
+static int tlbBatchDepth = 0;
+
+static inline bool isUserAddress(const void *page)
+{
+    return (unsigned long)page < 0x0000008000000000;
+}
+
+static inline unsigned long activeAsid()
+{
+    AddressSpace *active = activeAddressSpace[currentCpu()];
+    return active == nullptr ? 0 : active->getAsid() & ((1UL << asidBits) - 1);
+}
+
+/**
+ * @brief Waits for outstanding TLB maintenance, unless a batch is open.
+ */
+static inline void syncTLB()
+{
+    if (tlbBatchDepth == 0)
+    {
+        asm volatile("DSB ISH");
+        asm volatile("ISB");
+    }
+}
+
+/**
+ * @brief Makes an entry written over an invalid one visible to the table
+ * walker. No invalidation is needed, as invalid entries are never cached.
+ */
+static inline void publishEntry()
+{
+    asm volatile("DSB ISHST");
+    syncTLB();
+}
+
+/**
+ * @brief Invalidates cached translations of a single page. User pages are
+ * only invalidated for the active ASID; kernel pages for all ASIDs.
+ */
+static void invalidatePage(const void *page)
+{
+    unsigned long va = ((unsigned long)page >> 12) & 0xFFFFFFFFFFF;
+    asm volatile("DSB ISHST");
+    if (isUserAddress(page))
+    {
+        asm volatile("TLBI VAE1IS, %0" ::"r"(va | (activeAsid() << 48)));
+    }
+    else
+    {
+        asm volatile("TLBI VAAE1IS, %0" ::"r"(va));
+    }
+    syncTLB();
+}
+
+/**
+ * @brief Invalidates every cached translation in the half of the address
+ * space `page` belongs to. Used when a table or block entry changes, since
+ * that affects many pages (and the recursive mapping of the tables) at once.
+ */
+static void invalidateAddressSpace(const void *page)
+{
+    asm volatile("DSB ISHST");
+    if (isUserAddress(page))
+    {
+        asm volatile("TLBI ASIDE1IS, %0" ::"r"(activeAsid() << 48));
+    }
+    else
+    {
+        asm volatile("TLBI VMALLE1IS");
+    }
+    syncTLB();
+}
+
+/**
+ * @brief Finds the translation table entry at `level` for `page` without
+ * faulting in any missing tables.
+ *
+ * @return the entry, or nullptr if a table on the way is not present or is
+ * replaced by a block mapping
+ */
+static PageTableEntry *lookupEntry(int level, void *page)
+{
+    PageTableEntry *const *tables = (unsigned long)page >= (unsigned long)&__high_mem ? kernelTables : userTables;
+    unsigned long linearAddr = (unsigned long)page & 0x0000007FFFFFFFFF;
+    for (int i = 0; i < 2 - level; i++)
+    {
+        PageTableEntry &entry = tables[i][linearAddr >> (30 - i * 9)];
+        if (!entry.present || !entry.type)
+        {
+            return nullptr;
+        }
+    }
+    return &tables[2 - level][linearAddr >> (30 - (2 - level) * 9)];
+}
+
+/**
+ * @brief Replaces the 2 MiB block mapping `block`, which covers `page`, with
+ * the table in frame `table`, filled with pages mapping the same frames with
+ * the same attributes.
+ */
+static void replaceBlock(PageTableEntry *block, void *page, physaddr_t table)
+{
+    PageTableEntry *pages = (PageTableEntry *)physicalToLinear(table);
+    for (int i = 0; i < 512; i++)
+    {
+        pages[i] = *block;
+        pages[i].type = 1;
+        pages[i].physicalAddress(block->physicalAddress() + i * page_size);
+    }
+
+    // Break-before-make: the block must be invalidated before it is replaced
+    block->clear();
+    invalidateAddressSpace(page);
     asm volatile("DSB ISH");
-    asm volatile("TLBI VMALLE1");
+    block->makeTableDescriptor(table);
+    block->ng = isUserAddress(page) ? 1 : 0;
+    publishEntry();
+}
+
+/**
+ * @brief If `page` is covered by a 2 MiB block mapping, replaces the block
+ * with a table of pages mapping the same frames with the same attributes, so
+ * that individual pages inside it can be changed.
+ */
+static void splitBlock(void *page)
+{
+    PageTableEntry *block = lookupEntry(1, page);
+    if (block == nullptr || !block->present || block->type)
+    {
+        return;
+    }
+
+    physaddr_t table = pageAllocator.reserve(page_size);
+    if (table == PageAllocator::NOMEM)
+    {
+        kernelLog(LogLevel::PANIC, "Out of memory while splitting block mapping at %016x", page);
+        hacf();
+    }
+    replaceBlock(block, page, table);
+}
+
+/**
+ * @brief Drops a reference to every frame in a block or page mapping.
+ */
+static void releaseMapping(physaddr_t frame, unsigned long size, physaddr_t zeroPage)
+{
+    for (unsigned long p = 0; p < size; p += page_size)
+    {
+        if (frame + p != zeroPage)
+        {
+            pageAllocator.release(frame + p);
+        }
+    }
+}
+
+/**
+ * @brief Releases every frame mapped by the user tables rooted at `topFrame`,
+ * then frees the tables themselves. The tables are read through the physical
+ * window, so they must not be loaded, but need not ever have been.
+ *
+ * Frames are released rather than freed, so pages still shared with a forked
+ * address space survive. Both frames and tables go back to the page
+ * allocator's pending lists and are merged with their buddies later in bulk.
+ */
+static void reclaimTables(physaddr_t topFrame)
+{
+    physaddr_t zeroPage = getZeroPage();
+    physaddr_t tableFrames[teardownBatchSize];
+    unsigned long tableCount = 0;
+
+    PageTableEntry *top = (PageTableEntry *)physicalToLinear(topFrame);
+    for (unsigned long i = 0; i < 511; i++) // Entry 511 is the recursive mapping
+    {
+        if (!top[i].present)
+        {
+            continue;
+        }
+        else if (!top[i].type)
+        {
+            releaseMapping(top[i].physicalAddress(), getBlockSize(2), zeroPage);
+            continue;
+        }
+
+        PageTableEntry *mid = (PageTableEntry *)physicalToLinear(top[i].physicalAddress());
+        for (unsigned long j = 0; j < 512; j++)
+        {
+            if (!mid[j].present)
+            {
+                continue;
+            }
+            else if (!mid[j].type)
+            {
+                releaseMapping(mid[j].physicalAddress(), getBlockSize(1), zeroPage);
+                continue;
+            }
+
+            PageTableEntry *leaf = (PageTableEntry *)physicalToLinear(mid[j].physicalAddress());
+            for (unsigned long k = 0; k < 512; k++)
+            {
+                if (leaf[k].present)
+                {
+                    releaseMapping(leaf[k].physicalAddress(), page_size, zeroPage);
+                }
+            }
+
+            tableFrames[tableCount++] = mid[j].physicalAddress();
+            if (tableCount == teardownBatchSize)
+            {
+                pageAllocator.freeBatch(tableCount, tableFrames);
+                tableCount = 0;
+            }
+        }
+
+        tableFrames[tableCount++] = top[i].physicalAddress();
+        if (tableCount == teardownBatchSize)
+        {
+            pageAllocator.freeBatch(tableCount, tableFrames);
+            tableCount = 0;
+        }
+    }
+
+    tableFrames[tableCount++] = topFrame;
+    pageAllocator.freeBatch(tableCount, tableFrames);
+}
+
+/**
+ * @brief Adds the frames of a block or page mapping to the counts kept by
+ * `countResidentPages`.
+ */
+static void countMapping(physaddr_t frame, unsigned long size, physaddr_t zeroPage, unsigned long &resident, unsigned long &shared)
+{
+    for (unsigned long p = 0; p < size; p += page_size)
+    {
+        if (frame + p == zeroPage)
+        {
+            continue;
+        }
+        resident++;
+        if (pageAllocator.getRefCount(frame + p) > 1)
+        {
+            shared++;
+        }
+    }
+}
+
+void kernel::memory::countResidentPages(AddressSpace &addressSpace, unsigned long &resident, unsigned long &shared)
+{
+    physaddr_t zeroPage = getZeroPage();
+    resident = 0;
+    shared = 0;
+
+    PageTableEntry *top = (PageTableEntry *)physicalToLinear(addressSpace.getTableFrame());
+    for (unsigned long i = 0; i < 511; i++) // Entry 511 is the recursive mapping
+    {
+        if (!top[i].present)
+        {
+            continue;
+        }
+        else if (!top[i].type)
+        {
+            countMapping(top[i].physicalAddress(), getBlockSize(2), zeroPage, resident, shared);
+            continue;
+        }
+
+        PageTableEntry *mid = (PageTableEntry *)physicalToLinear(top[i].physicalAddress());
+        for (unsigned long j = 0; j < 512; j++)
+        {
+            if (!mid[j].present)
+            {
+                continue;
+            }
+            else if (!mid[j].type)
+            {
+                countMapping(mid[j].physicalAddress(), getBlockSize(1), zeroPage, resident, shared);
+                continue;
+            }
+
+            PageTableEntry *leaf = (PageTableEntry *)physicalToLinear(mid[j].physicalAddress());
+            for (unsigned long k = 0; k < 512; k++)
+            {
+                if (leaf[k].present)
+                {
+                    countMapping(leaf[k].physicalAddress(), page_size, zeroPage, resident, shared);
+                }
+            }
+        }
+    }
+}
+
+void kernel::memory::destoryAddressSpace(AddressSpace &addressSpace)
+{
+    // Stale translations tagged with this ASID are harmless: the ASID is not
+    // handed out again until the next generation, which flushes the TLB.
+    unsigned long cpus = 0;
+    for (int i = 0; i < maxCpus; i++)
+    {
+        if (activeAddressSpace[i] == &addressSpace)
+        {
+            cpus |= 1UL << i;
+            activeAddressSpace[i] = nullptr;
+        }
+    }
+
+    if (cpus == 0)
+    {
+        reclaimTables(addressSpace.getTableFrame());
+        return;
+    }
+    // The tables are still in use until those processors load another
+    // address space
+    for (int i = 0; i < maxCpus; i++)
+    {
+        if (deferredTeardown[i].cpus == 0)
+        {
+            deferredTeardown[i].topFrame = addressSpace.getTableFrame();
+            deferredTeardown[i].cpus = cpus;
+            return;
+        }
+    }
+    // Unreachable while each processor is counted in at most one slot, but
+    // reclaim now rather than leak the tables if that ever stops holding
+    reclaimTables(addressSpace.getTableFrame());
+}
+
+static bool isReservedAsid(unsigned long asid)
+{
+    return (reservedAsids[asid / 64] & (1UL << (asid % 64))) != 0;
+}
+
+/**
+ * @brief Starts a new ASID generation and flushes every processor's TLB.
+ * Address spaces loaded on other processors keep their ASIDs, moved into
+ * the new generation.
+ */
+static void newAsidGeneration()
+{
+    const unsigned long asidMask = (1UL << asidBits) - 1;
+    asidGeneration += 1UL << asidBits;
+    nextAsid = 1;
+    for (unsigned long i = 0; i < sizeof(reservedAsids) / sizeof(*reservedAsids); i++)
+    {
+        reservedAsids[i] = 0;
+    }
+    for (int i = 0; i < maxCpus; i++)
+    {
+        AddressSpace *active = activeAddressSpace[i];
+        if (i != currentCpu() && active != nullptr)
+        {
+            unsigned long asid = active->getAsid() & asidMask;
+            active->setAsid(asidGeneration | asid);
+            reservedAsids[asid / 64] |= 1UL << (asid % 64);
+        }
+    }
+    asm volatile("DSB ISHST");
+    asm volatile("TLBI VMALLE1IS");
     asm volatile("DSB ISH");
+}
+
+void kernel::memory::loadAddressSpace(AddressSpace &addressSpace)
+{
+    const unsigned long asidMask = (1UL << asidBits) - 1;
+    if ((addressSpace.getAsid() & ~asidMask) != asidGeneration)
+    {
+        while (nextAsid <= asidMask && isReservedAsid(nextAsid))
+        {
+            nextAsid++;
+        }
+        if (nextAsid > asidMask)
+        {
+            newAsidGeneration();
+            while (isReservedAsid(nextAsid))
+            {
+                nextAsid++;
+            }
+        }
+        // A new generation may have kept this address space's ASID, if it
+        // is also loaded on another processor
+        if ((addressSpace.getAsid() & ~asidMask) != asidGeneration)
+        {
+            addressSpace.setAsid(asidGeneration | nextAsid);
+            nextAsid++;
+        }
+    }
+
+    // User mappings are tagged with the ASID, so nothing needs flushing here
+    int cpu = currentCpu();
+    activeAddressSpace[cpu] = &addressSpace;
+    unsigned long ttbr0 = addressSpace.getTableFrame() | ((addressSpace.getAsid() & asidMask) << 48);
+    set_ttbr0_el1(ttbr0);
     asm volatile("ISB");
+
+    for (int i = 0; i < maxCpus; i++)
+    {
+        if ((deferredTeardown[i].cpus & (1UL << cpu)) != 0)
+        {
+            deferredTeardown[i].cpus &= ~(1UL << cpu);
+            if (deferredTeardown[i].cpus == 0)
+            {
+                reclaimTables(deferredTeardown[i].topFrame);
+            }
+        }
+    }
+}
+
+void kernel::memory::beginTLBBatch()
+{
+    tlbBatchDepth++;
+}
+
+void kernel::memory::endTLBBatch()
+{
+    tlbBatchDepth--;
+    syncTLB();
+}
+
+AddressSpace *kernel::memory::getActiveAddressSpace()
+{
+    return activeAddressSpace[currentCpu()];
+}
+
+void *kernel::memory::physicalToLinear(physaddr_t frame)
+{
+    return (void *)((unsigned long)&__high_mem + physicalWindowOffset + frame);
+}
+
+static void zeroFrame(physaddr_t frame)
+{
+    unsigned long *p = (unsigned long *)physicalToLinear(frame);
+    for (unsigned long i = 0; i < page_size / sizeof(*p); i++)
+    {
+        p[i] = 0;
+    }
+}
+
+AddressSpace *kernel::memory::cloneAddressSpace()
+{
+    AddressSpace *active = getActiveAddressSpace();
+    if (active == nullptr)
+    {
+        return nullptr;
+    }
+
+    // Count and reserve every table the copy will need up front, along with
+    // one for each of the parent's blocks, which copy-on-write must split
+    // into pages, so that running out of memory leaves the parent untouched
+    unsigned long tableCount = 0;
+    unsigned long blockCount = 0;
+    for (unsigned long i = 0; i < 511; i++)
+    {
+        if (!userTables[0][i].present)
+        {
+            continue;
+        }
+        tableCount++;
+        for (unsigned long j = 0; j < 512; j++)
+        {
+            PageTableEntry &entry = userTables[1][i * 512 + j];
+            if (entry.present)
+            {
+                tableCount++;
+            }
+            if (entry.present && !entry.type)
+            {
+                blockCount++;
+            }
+        }
+    }
+
+    physaddr_t *tableFrames = new physaddr_t[tableCount + blockCount + 1];
+    if (tableFrames == nullptr)
+    {
+        return nullptr;
+    }
+    unsigned long reserved = pageAllocator.reserveBatch(tableCount + blockCount, 0, tableFrames);
+    AddressSpace *copy = reserved == tableCount + blockCount ? createAddressSpace() : nullptr;
+    if (copy == nullptr || copy->copyRegions(*active) != ENONE)
+    {
+        pageAllocator.freeBatch(reserved, tableFrames);
+        delete[] tableFrames;
+        if (copy != nullptr)
+        {
+            pageAllocator.free(copy->getTableFrame());
+            delete copy;
+        }
+        return nullptr;
+    }
+
+    // Copy-on-write works on individual pages
+    unsigned long nextTable = tableCount;
+    for (unsigned long i = 0; i < 511; i++)
+    {
+        if (!userTables[0][i].present)
+        {
+            continue;
+        }
+        for (unsigned long j = 0; j < 512; j++)
+        {
+            PageTableEntry &entry = userTables[1][i * 512 + j];
+            if (entry.present && !entry.type)
+            {
+                replaceBlock(&entry, (void *)((i * 512 + j) << 21), tableFrames[nextTable++]);
+            }
+        }
+    }
+
+    physaddr_t zeroPage = getZeroPage();
+    PageTableEntry *childTop = (PageTableEntry *)physicalToLinear(copy->getTableFrame());
+    nextTable = 0;
+    for (unsigned long i = 0; i < 511; i++)
+    {
+        if (!userTables[0][i].present)
+        {
+            continue;
+        }
+        physaddr_t midFrame = tableFrames[nextTable++];
+        zeroFrame(midFrame);
+        childTop[i].makeTableDescriptor(midFrame);
+        childTop[i].ng = 1;
+        PageTableEntry *childMid = (PageTableEntry *)physicalToLinear(midFrame);
+        for (unsigned long j = 0; j < 512; j++)
+        {
+            PageTableEntry &midEntry = userTables[1][i * 512 + j];
+            if (!midEntry.present)
+            {
+                continue;
+            }
+            physaddr_t leafFrame = tableFrames[nextTable++];
+            zeroFrame(leafFrame);
+            childMid[j].makeTableDescriptor(leafFrame);
+            childMid[j].ng = 1;
+            PageTableEntry *childLeaf = (PageTableEntry *)physicalToLinear(leafFrame);
+            for (unsigned long k = 0; k < 512; k++)
+            {
+                PageTableEntry &entry = userTables[2][(i * 512 + j) * 512 + k];
+                if (!entry.present)
+                {
+                    continue;
+                }
+                if (!entry.apReadOnly && !entry.shared)
+                {
+                    // Both copies now fault on write; see handleCopyOnWrite()
+                    entry.apReadOnly = 1;
+                    entry.cow = 1;
+                }
+                childLeaf[k] = entry;
+                if (entry.physicalAddress() != zeroPage)
+                {
+                    pageAllocator.addReference(entry.physicalAddress());
+                }
+            }
+        }
+    }
+    delete[] tableFrames;
+
+    // Parent pages were made read-only
+    invalidateAddressSpace(nullptr);
+    return copy;
 }
 
 void kernel::memory::initializeTopTable(physaddr_t frame)
 {
-    static PageTableEntry *scratchAddr = (PageTableEntry *)0xFFFFFFFFBFFFF000;
-    physaddr_t buffer = getPageFrame(scratchAddr);
-    setPageEntry(0, scratchAddr, frame, PAGE_RW);
+    PageTableEntry *table = (PageTableEntry *)physicalToLinear(frame);
     for (int i = 0; i < 511; i++)
     {
-        ((unsigned long *)scratchAddr)[i] = 0;
+        table[i].clear();
     }
-    scratchAddr[511].makeTableDescriptor(frame);
-    setPageEntry(0, scratchAddr, buffer, PAGE_RW);
+
+    // Recursive entry; the tables are mapped per address space, so not global
+    table[511].makeTableDescriptor(frame);
+    table[511].ng = 1;
+    asm volatile("DSB ISHST");
 }
 
 size_t kernel::memory::getBlockSize(int level)
@@ -197,6 +862,8 @@ size_t kernel::memory::getBlockSize(int level)
         return (1UL << 12);
     case 1:
         return (1UL << 21);
+    case 2:
+        return (1UL << 30);
     default:
         return 0;
     }
@@ -216,7 +883,8 @@ physaddr_t kernel::memory::getPageFrame(void *page)
         }
         else if (!tables[i][index].type)
         {
-            return tables[i][index].physicalAddress();
+            unsigned long blockOffset = linearAddr & ((1UL << (30 - i * 9)) - 1);
+            return tables[i][index].physicalAddress() + blockOffset;
         }
     }
 
@@ -233,7 +901,21 @@ void kernel::memory::setPageEntry(int level, void *page, physaddr_t frame, int f
     {
         return;
     }
+    else if (level == 0)
+    {
+        splitBlock(page);
+    }
+
+    // A block replaces any table previously installed in its place
+    physaddr_t oldTable = 0;
+    PageTableEntry *existing = lookupEntry(level, page);
+    bool wasPresent = existing != nullptr && existing->present;
+    if (level > 0 && wasPresent && existing->type)
+    {
+        oldTable = existing->physicalAddress();
+    }
 
+    void *va = page;
     PageTableEntry *entry;
     if ((unsigned long)page >= (unsigned long)&__high_mem)
     {
@@ -255,10 +937,25 @@ void kernel::memory::setPageEntry(int level, void *page, physaddr_t frame, int f
     {
         entry->makeBlockDescriptor(frame, flags);
     }
-    asm volatile("DSB ISH");
-    asm volatile("TLBI VMALLE1");
-    asm volatile("DSB ISH");
-    asm volatile("ISB");
+    entry->ng = isUserAddress(va) ? 1 : 0;
+
+    if (!wasPresent)
+    {
+        publishEntry();
+    }
+    else if (level == 0)
+    {
+        invalidatePage(va);
+    }
+    else
+    {
+        invalidateAddressSpace(va);
+    }
+
+    if (oldTable != 0)
+    {
+        pageAllocator.free(oldTable);
+    }
 }
 
 void kernel::memory::setTableEntry(int level, void *page, physaddr_t table)
@@ -268,6 +965,7 @@ void kernel::memory::setTableEntry(int level, void *page, physaddr_t table)
         return;
     }
 
+    void *va = page;
     PageTableEntry *entry;
     if ((unsigned long)page >= (unsigned long)&__high_mem)
     {
@@ -282,31 +980,39 @@ void kernel::memory::setTableEntry(int level, void *page, physaddr_t table)
     }
 
     entry->makeTableDescriptor(table);
-    asm volatile("DSB ISH");
-    asm volatile("TLBI VMALLE1");
-    asm volatile("DSB ISH");
-    asm volatile("ISB");
+    entry->ng = isUserAddress(va) ? 1 : 0;
+    invalidateAddressSpace(va);
 }
 
 void kernel::memory::clearEntry(int level, void *page)
 {
-    PageTableEntry *entry;
-    if ((unsigned long)page >= (unsigned long)&__high_mem)
+    if (level == 0)
     {
-        page = (void *)((unsigned long)page - (unsigned long)&__high_mem);
-        unsigned long index = (unsigned long)page >> (12 + 9 * level);
-        entry = &kernelTables[2 - level][index];
+        splitBlock(page);
     }
-    else if ((unsigned long)page < 0x0000008000000000)
+
+    PageTableEntry *entry = lookupEntry(level, page);
+    if (entry == nullptr || !entry->present)
     {
-        unsigned long index = (unsigned long)page >> (12 + 9 * level);
-        entry = &userTables[2 - level][index];
+        return;
     }
+
+    // Clearing a table entry unmaps everything below it; free the table
+    physaddr_t oldTable = (level > 0 && entry->type) ? entry->physicalAddress() : 0;
     entry->clear();
-    asm volatile("DSB ISH");
-    asm volatile("TLBI VMALLE1");
-    asm volatile("DSB ISH");
-    asm volatile("ISB");
+    if (level == 0)
+    {
+        invalidatePage(page);
+    }
+    else
+    {
+        invalidateAddressSpace(page);
+    }
+
+    if (oldTable != 0)
+    {
+        pageAllocator.free(oldTable);
+    }
 }
 
 void fillTranslationTable(int faultLevel, int targetLevel, void *far)
@@ -323,26 +1029,254 @@ void fillTranslationTable(int faultLevel, int targetLevel, void *far)
     }
 
     unsigned long farOffset = (unsigned long)far - (unsigned long)tables[targetLevel];
-    for (int i = (targetLevel + faultLevel - 4); i < targetLevel; i++)
+    int first = targetLevel + faultLevel - 4;
+    unsigned long tableCount = targetLevel - first;
+    physaddr_t tableFrames[3];
+    if (pageAllocator.reserveBatch(tableCount, 0, tableFrames) != tableCount)
+    {
+        kernelLog(LogLevel::PANIC, "Out of memory while allocating page table");
+        hacf();
+    }
+    for (int i = first; i < targetLevel; i++)
     {
         unsigned long tableIndex = farOffset >> (12 + 9 * (targetLevel - i - 1));
-        physaddr_t tableFrame = pageAllocator.reserve(page_size);
-        if (tableFrame == PageAllocator::NOMEM)
+        tables[i][tableIndex].makeTableDescriptor(tableFrames[i - first]);
+        tables[i][tableIndex].ng = tables == userTables ? 1 : 0;
+
+        // The entry was invalid, so it can't be cached; just publish it
+        asm volatile("DSB ISHST");
+        asm volatile("ISB");
+
+        // Frames may have been used before; clear out any stale entries
+        PageTableEntry *newTable = &tables[i + 1][tableIndex * 512];
+        for (int j = 0; j < 512; j++)
         {
-            kernelLog(LogLevel::PANIC, "Out of memory while allocating page table");
-            hacf();
+            newTable[j].clear();
         }
-        tables[i][tableIndex].makeTableDescriptor(tableFrame);
-        asm volatile("DSB ISH");
-        asm volatile("TLBI VMALLE1");
-        asm volatile("DSB ISH");
-        asm volatile("ISB");
     }
 }
 
-void handlePageFault(ExceptionClass type, SyndromeDataAbort syndrome)
+/**
+ * @brief Attempts to resolve a write to a page shared copy-on-write. If the
+ * frame is still shared, the writer gets a private copy; otherwise the page
+ * is simply made writable again.
+ *
+ * @return true if the faulting access can be retried
+ */
+static bool handleCopyOnWrite(void *far, SyndromeDataAbort syndrome)
+{
+    if (!syndrome.wnr || far >= userTables[2] || syndrome.statusCode != DataAbortStatus::PERM_FAULT_3)
+    {
+        return false;
+    }
+
+    // Permission faults at level 3 imply every table on the way is present
+    PageTableEntry *entry = &userTables[2][(unsigned long)far >> 12];
+    if (!entry->cow)
+    {
+        return false;
+    }
+
+    void *page = (void *)((unsigned long)far & ~(page_size - 1));
+    physaddr_t frame = entry->physicalAddress();
+    int flags = entry->permissions() | PAGE_RW;
+    if (pageAllocator.getRefCount(frame) == 1)
+    {
+        setPageEntry(0, page, frame, flags);
+        return true;
+    }
+
+    physaddr_t copy = pageAllocator.reserve(page_size);
+    if (copy == PageAllocator::NOMEM)
+    {
+        kernelLog(LogLevel::PANIC, "Out of memory while copying page at %016x", far);
+        hacf();
+    }
+    memcpy(physicalToLinear(copy), physicalToLinear(frame), page_size);
+    setPageEntry(0, page, copy, flags);
+    pageAllocator.release(frame);
+    return true;
+}
+
+void kernel::memory::syncInstructionCache(void *addr, size_t size)
+{
+    unsigned long ctr;
+    asm volatile("mrs %0, ctr_el0" : "=r"(ctr));
+    unsigned long lineSize = 4UL << ((ctr >> 16) & 0xF);
+    for (unsigned long p = (unsigned long)addr & ~(lineSize - 1); p < (unsigned long)addr + size; p += lineSize)
+    {
+        asm volatile("dc cvau, %0" ::"r"(p));
+    }
+    asm volatile("dsb ish");
+    asm volatile("ic iallu");
+    asm volatile("dsb ish");
+    asm volatile("isb");
+}
+
+/**
+ * @brief Maps the page of a program image containing `far`, filled from the
+ * region's source. Only faults on pages that are not mapped yet are handled;
+ * writes to read-only segments are left to fail.
+ */
+static bool handleImageFault(void *far, SyndromeDataAbort syndrome, AddressSpace::Region *region)
+{
+    switch (syndrome.statusCode)
+    {
+    case DataAbortStatus::TRANSLATE_FAULT_0:
+    case DataAbortStatus::TRANSLATE_FAULT_1:
+    case DataAbortStatus::TRANSLATE_FAULT_2:
+    case DataAbortStatus::TRANSLATE_FAULT_3:
+        break;
+    default:
+        return false;
+    }
+
+    if (syndrome.wnr && !(region->flags & PAGE_RW))
+    {
+        return false;
+    }
+
+    void *page = (void *)((unsigned long)far & ~(page_size - 1));
+    physaddr_t frame = pageAllocator.reserve(page_size);
+    if (frame == PageAllocator::NOMEM)
+    {
+        kernelLog(LogLevel::PANIC, "Out of memory while handling page fault at %016x", far);
+        hacf();
+    }
+    void *dest = physicalToLinear(frame);
+    if (region->fill(page, dest) != ENONE)
+    {
+        kernelLog(LogLevel::WARNING, "Could not read program image page at %016x", page);
+        pageAllocator.release(frame);
+        return false;
+    }
+    if (region->flags & PAGE_EXE)
+    {
+        syncInstructionCache(dest, page_size);
+    }
+    setPageEntry(0, page, frame, region->flags);
+    return true;
+}
+
+/**
+ * @brief Attempts to resolve a fault on a lazily-backed region of the active
+ * address space. Reads of untouched pages map the shared zero page; writes
+ * map a private zeroed frame, replacing the zero page if necessary.
+ *
+ * @return true if the faulting access can be retried, false if the fault is
+ * not the result of demand paging.
+ */
+static bool handleRegionFault(void *far, SyndromeDataAbort syndrome)
+{
+    AddressSpace *active = getActiveAddressSpace();
+    if (active == nullptr || far >= userTables[2])
+    {
+        return false;
+    }
+
+    // Only anonymous regions and program images are backed on demand
+    AddressSpace::Region *region = active->findRegion(far);
+    if (region != nullptr && region->type == AddressSpace::Region::Type::IMAGE)
+    {
+        return handleImageFault(far, syndrome, region);
+    }
+    else if (region == nullptr || region->type != AddressSpace::Region::Type::ANONYMOUS)
+    {
+        return false;
+    }
+
+    void *page = (void *)((unsigned long)far & ~(page_size - 1));
+    switch (syndrome.statusCode)
+    {
+    case DataAbortStatus::TRANSLATE_FAULT_0:
+    case DataAbortStatus::TRANSLATE_FAULT_1:
+    case DataAbortStatus::TRANSLATE_FAULT_2:
+    case DataAbortStatus::TRANSLATE_FAULT_3:
+        if (!syndrome.wnr)
+        {
+            physaddr_t zeroPage = getZeroPage();
+            if (zeroPage == PageAllocator::NOMEM)
+            {
+                return false;
+            }
+            setPageEntry(0, page, zeroPage, region->flags & ~PAGE_RW);
+            return true;
+        }
+        break;
+    case DataAbortStatus::PERM_FAULT_0:
+    case DataAbortStatus::PERM_FAULT_1:
+    case DataAbortStatus::PERM_FAULT_2:
+    case DataAbortStatus::PERM_FAULT_3:
+        if (!syndrome.wnr || getPageFrame(page) != getZeroPage())
+        {
+            return false;
+        }
+        break;
+    default:
+        return false;
+    }
+
+    if (!(region->flags & PAGE_RW))
+    {
+        return false;
+    }
+
+    physaddr_t frame = pageAllocator.reserveZeroed();
+    if (frame == PageAllocator::NOMEM)
+    {
+        kernelLog(LogLevel::PANIC, "Out of memory while handling page fault at %016x", far);
+        hacf();
+    }
+    setPageEntry(0, page, frame, region->flags);
+    return true;
+}
+
+/**
+ * @brief An instruction allowed to fault on user memory, and where to resume
+ * when it does. Entries are emitted by the `user_access` macro in
+ * usercopy.s.
+ */
+struct FixupEntry
+{
+    unsigned long address;
+    unsigned long fixup;
+};
+
+extern "C" const FixupEntry __fixup_table_start[];
+
+extern "C" const FixupEntry __fixup_table_end[];
+
+static unsigned long findFixup(unsigned long address)
+{
+    for (const FixupEntry *entry = __fixup_table_start; entry < __fixup_table_end; entry++)
+    {
+        if (entry->address == address)
+        {
+            return entry->fixup;
+        }
+    }
+    return 0;
+}
+
+void handlePageFault(ExceptionClass type, SyndromeDataAbort syndrome, unsigned long *returnAddress)
 {
     void *far = get_far_el1();
+    if (handleCopyOnWrite(far, syndrome) || handleRegionFault(far, syndrome))
+    {
+        return;
+    }
+
+    // A bad user pointer passed to the kernel is the caller's error
+    if (type == ExceptionClass::DATA_ABORT_EL1 && returnAddress != nullptr && far < userTables[2])
+    {
+        unsigned long fixup = findFixup(*returnAddress);
+        if (fixup != 0)
+        {
+            *returnAddress = fixup;
+            return;
+        }
+    }
+
     switch (syndrome.statusCode)
     {
     case DataAbortStatus::ACCESS_FAULT_0:
@@ -0,0 +1,115 @@
+.section .text
+
+// Runs `insn`, which touches user memory, and records it in the fixup
+// table so that a fault it cannot recover from resumes at `fixup` instead
+// of panicking. See handlePageFault().
+.macro user_access fixup, insn:vararg
+_user_access_\@:
+    \insn
+    .pushsection .fixup_table, "a"
+    .quad _user_access_\@, \fixup
+    .popsection
+.endm
+
+# unsigned long copy_user(void *dest, const void *src, unsigned long count);
+#
+# Copies like memcpy, but either pointer may be a user address. Returns the
+# number of bytes that were not copied, which is 0 on success.
+.global copy_user
+copy_user:
+    // x3 only advances past bytes that have definitely been stored, so a
+    // fault reports end - x3 bytes left
+    mov x3, x0
+    add x4, x0, x2
+    cmp x2, #16
+    b.lo _copy_user_small
+
+    user_access _copy_user_fault, ldp x5, x6, [x1]
+    user_access _copy_user_fault, stp x5, x6, [x3]
+    neg x7, x3
+    and x7, x7, #15
+    add x1, x1, x7
+    add x3, x3, x7
+    sub x2, x2, x7
+
+_copy_user_64:
+    cmp x2, #64
+    b.lo _copy_user_16
+    user_access _copy_user_fault, ldp x5, x6, [x1]
+    user_access _copy_user_fault, ldp x7, x8, [x1, #16]
+    user_access _copy_user_fault, ldp x9, x10, [x1, #32]
+    user_access _copy_user_fault, ldp x11, x12, [x1, #48]
+    user_access _copy_user_fault, stp x5, x6, [x3]
+    user_access _copy_user_fault, stp x7, x8, [x3, #16]
+    user_access _copy_user_fault, stp x9, x10, [x3, #32]
+    user_access _copy_user_fault, stp x11, x12, [x3, #48]
+    add x1, x1, #64
+    add x3, x3, #64
+    sub x2, x2, #64
+    b _copy_user_64
+
+_copy_user_16:
+    cmp x2, #16
+    b.lo _copy_user_last
+    user_access _copy_user_fault, ldp x5, x6, [x1]
+    user_access _copy_user_fault, stp x5, x6, [x3]
+    add x1, x1, #16
+    add x3, x3, #16
+    sub x2, x2, #16
+    b _copy_user_16
+
+_copy_user_last:
+    // Finish with the 16 bytes ending at the end of the buffer
+    cbz x2, _copy_user_done
+    add x1, x1, x2
+    add x5, x3, x2
+    user_access _copy_user_fault, ldp x6, x7, [x1, #-16]
+    user_access _copy_user_fault, stp x6, x7, [x5, #-16]
+_copy_user_done:
+    mov x0, #0
+    ret
+
+_copy_user_small:
+    tbz x2, #3, 1f
+    user_access _copy_user_fault, ldr x5, [x1], #8
+    user_access _copy_user_fault, str x5, [x3]
+    add x3, x3, #8
+1:  tbz x2, #2, 2f
+    user_access _copy_user_fault, ldr w5, [x1], #4
+    user_access _copy_user_fault, str w5, [x3]
+    add x3, x3, #4
+2:  tbz x2, #1, 3f
+    user_access _copy_user_fault, ldrh w5, [x1], #2
+    user_access _copy_user_fault, strh w5, [x3]
+    add x3, x3, #2
+3:  tbz x2, #0, 4f
+    user_access _copy_user_fault, ldrb w5, [x1]
+    user_access _copy_user_fault, strb w5, [x3]
+4:  mov x0, #0
+    ret
+
+_copy_user_fault:
+    sub x0, x4, x3
+    ret
+
+# long strncpy_user(char *dest, const char *src, unsigned long count);
+#
+# Copies a string from user memory, stopping after the terminating null or
+# after `count` bytes. Returns the length of the string, `count` if no
+# terminator was found, or -1 if reading `src` faulted.
+.global strncpy_user
+strncpy_user:
+    mov x3, #0
+1:  cmp x3, x2
+    b.hs 2f
+    user_access _strncpy_user_fault, ldrb w4, [x1, x3]
+    strb w4, [x0, x3]
+    cbz w4, 2f
+    add x3, x3, #1
+    b 1b
+2:  mov x0, x3
+    ret
+
+_strncpy_user_fault:
+    mov x0, #-1
+    ret
@@ -1,10 +1,77 @@
 #include "addressspace.h"
+#include "mmap.h"
+#include "types/status.h"
+#include "util/string.h"
 
 using namespace kernel::memory;
 
+AddressSpace::Region::Region(void *base, size_t size, int flags, Type type)
+    : base(base), size(size), flags(flags), type(type), source(nullptr), sourceOffset(0), sourceSize(0), next(nullptr)
+{
+}
+
+AddressSpace::Region::~Region()
+{
+    setSource(nullptr, 0, 0);
+}
+
+void AddressSpace::Region::setSource(PageSource *source, unsigned long offset, unsigned long size)
+{
+    if (source != nullptr)
+    {
+        source->addReference();
+    }
+    if (this->source != nullptr)
+    {
+        this->source->removeReference();
+        if (this->source->getRefCount() <= 0)
+        {
+            delete this->source;
+        }
+    }
+    this->source = source;
+    sourceOffset = offset;
+    sourceSize = size;
+}
+
+int AddressSpace::Region::fill(const void *page, void *dest) const
+{
+    unsigned long start = (unsigned long)page - (unsigned long)base;
+    memset(dest, 0, page_size);
+    if (source == nullptr || start >= sourceSize)
+    {
+        return ENONE;
+    }
+    unsigned long length = sourceSize - start < page_size ? sourceSize - start : page_size;
+    return source->read(sourceOffset + start, dest, length);
+}
+
+void AddressSpace::Region::advance(unsigned long bytes)
+{
+    base = (void *)((unsigned long)base + bytes);
+    size -= bytes;
+    sourceOffset += bytes;
+    sourceSize = sourceSize > bytes ? sourceSize - bytes : 0;
+}
+
+bool AddressSpace::Region::contains(const void *addr) const
+{
+    return (unsigned long)addr >= (unsigned long)base && (unsigned long)addr - (unsigned long)base < size;
+}
+
+void *AddressSpace::Region::end() const
+{
+    return (void *)((unsigned long)base + size);
+}
+
 AddressSpace::AddressSpace(physaddr_t frame, int id)
-    : topLevelTable(frame), id(id)
+    : topLevelTable(frame), id(id), asid(0), regions(nullptr)
+{
+}
+
+AddressSpace::~AddressSpace()
 {
+    clearRegions();
 }
 
 physaddr_t AddressSpace::getTableFrame() const
@@ -16,3 +83,132 @@ int AddressSpace::getId() const
 {
     return id;
 }
+
+unsigned long AddressSpace::getAsid() const
+{
+    return asid;
+}
+
+void AddressSpace::setAsid(unsigned long asid)
+{
+    this->asid = asid;
+}
+
+int AddressSpace::addRegion(void *base, size_t size, int flags, Region::Type type)
+{
+    unsigned long start = (unsigned long)base;
+    Region **link = &regions;
+    while (*link != nullptr && (unsigned long)(*link)->end() <= start)
+    {
+        link = &(*link)->next;
+    }
+    if (*link != nullptr && (unsigned long)(*link)->base < start + size)
+    {
+        return EEXISTS;
+    }
+
+    Region *region = new Region(base, size, flags, type);
+    if (region == nullptr)
+    {
+        return ENOMEM;
+    }
+    region->next = *link;
+    *link = region;
+    return ENONE;
+}
+
+int AddressSpace::removeRegion(void *base, size_t size)
+{
+    unsigned long start = (unsigned long)base;
+    unsigned long end = start + size;
+    Region **link = &regions;
+    while (*link != nullptr)
+    {
+        Region *r = *link;
+        unsigned long regionStart = (unsigned long)r->base;
+        unsigned long regionEnd = (unsigned long)r->end();
+        if (regionEnd <= start || regionStart >= end)
+        {
+            link = &r->next;
+        }
+        else if (regionStart < start && regionEnd > end)
+        {
+            // Range is in the middle of this region; split it in two. The
+            // range lies strictly inside r, which is the only region the
+            // range overlaps, so nothing has changed yet if allocation fails.
+            Region *tail = new Region(r->base, r->size, r->flags, r->type);
+            if (tail == nullptr)
+            {
+                return ENOMEM;
+            }
+            tail->setSource(r->source, r->sourceOffset, r->sourceSize);
+            tail->advance(end - regionStart);
+            tail->next = r->next;
+            r->next = tail;
+            r->size = start - regionStart;
+            link = &tail->next;
+        }
+        else if (regionStart < start)
+        {
+            r->size = start - regionStart;
+            link = &r->next;
+        }
+        else if (regionEnd > end)
+        {
+            r->advance(end - regionStart);
+            link = &r->next;
+        }
+        else
+        {
+            *link = r->next;
+            delete r;
+        }
+    }
+    return ENONE;
+}
+
+int AddressSpace::copyRegions(const AddressSpace &other)
+{
+    clearRegions();
+    Region **link = &regions;
+    for (Region *r = other.regions; r != nullptr; r = r->next)
+    {
+        Region *copy = new Region(r->base, r->size, r->flags, r->type);
+        if (copy == nullptr)
+        {
+            clearRegions();
+            return ENOMEM;
+        }
+        copy->setSource(r->source, r->sourceOffset, r->sourceSize);
+        *link = copy;
+        link = &copy->next;
+    }
+    return ENONE;
+}
+
+AddressSpace::Region *AddressSpace::findRegion(const void *addr) const
+{
+    for (Region *r = regions; r != nullptr && (unsigned long)r->base <= (unsigned long)addr; r = r->next)
+    {
+        if (r->contains(addr))
+        {
+            return r;
+        }
+    }
+    return nullptr;
+}
+
+AddressSpace::Region *AddressSpace::firstRegion() const
+{
+    return regions;
+}
+
+void AddressSpace::clearRegions()
+{
+    while (regions != nullptr)
+    {
+        Region *r = regions;
+        regions = r->next;
+        delete r;
+    }
+}
@@ -3,6 +3,8 @@
 
 #include "util/hasrefcount.h"
 #include "types/physaddr.h"
+#include "pagesource.h"
+#include <cstddef>
 
 namespace kernel::memory
 {
@@ -10,18 +12,185 @@ namespace kernel::memory
     class AddressSpace : public HasRefcount
     {
     public:
+        /**
+         * @brief Describes a range of user memory whose pages are only backed
+         * by physical frames when they are first touched.
+         */
+        class Region
+        {
+        public:
+            enum class Type
+            {
+                /**
+                 * @brief Zero-filled memory not associated with any file
+                 */
+                ANONYMOUS,
+
+                /**
+                 * @brief Frames of a `SharedMemory` segment. Every page is
+                 * mapped when the region is created.
+                 */
+                SHARED,
+
+                /**
+                 * @brief Pages of a file, mapped when the region is created.
+                 * They are either frames of the file system image itself,
+                 * which the region does not own, or private copies.
+                 */
+                FILE,
+
+                /**
+                 * @brief Part of a program image. Each page is filled from
+                 * the region's source when first touched.
+                 */
+                IMAGE
+            };
+
+            Region(void *base, size_t size, int flags, Type type);
+
+            ~Region();
+
+            /**
+             * @brief Sets where the pages of an IMAGE region are read from,
+             * taking a reference to `source`.
+             *
+             * @param source source of the region's contents
+             * @param offset offset in `source` of the data at `base`
+             * @param size number of bytes from `base` to read from `source`;
+             * anything past them is zero-filled
+             */
+            void setSource(PageSource *source, unsigned long offset, unsigned long size);
+
+            /**
+             * @brief Writes the initial contents of the page at `page`, which
+             * must be inside this region, to `dest`.
+             *
+             * @param page page-aligned user address inside this region
+             * @param dest kernel address of a page-sized buffer
+             * @return ENONE, or an error from the region's source
+             */
+            int fill(const void *page, void *dest) const;
+
+            /**
+             * @brief Moves the start of this region forward by `bytes`,
+             * keeping its source lined up with the remaining pages.
+             */
+            void advance(unsigned long bytes);
+
+            /**
+             * @brief Checks whether `addr` lies inside this region.
+             */
+            bool contains(const void *addr) const;
+
+            /**
+             * @return the first address after the end of this region
+             */
+            void *end() const;
+
+            void *base;
+
+            size_t size;
+
+            /**
+             * @brief Permission flags (see `PageFlags`) applied to pages
+             * mapped inside this region
+             */
+            int flags;
+
+            Type type;
+
+            /**
+             * @brief Source of the contents of an IMAGE region, or nullptr
+             */
+            PageSource *source;
+
+            /**
+             * @brief Offset in `source` of the data at `base`
+             */
+            unsigned long sourceOffset;
+
+            /**
+             * @brief Number of bytes from `base` that are read from `source`
+             */
+            unsigned long sourceSize;
+
+            Region *next;
+        };
+
         AddressSpace(physaddr_t frame, int id);
 
+        ~AddressSpace();
+
         physaddr_t getTableFrame() const;
 
         int getId() const;
 
+        /**
+         * @brief Gets the tag the MMU uses to tell this address space's
+         * cached translations apart from others. Managed by platform code;
+         * 0 until the address space is first loaded.
+         */
+        unsigned long getAsid() const;
+
+        void setAsid(unsigned long asid);
+
+        /**
+         * @brief Records a new region of lazily-backed memory. No frames are
+         * reserved or mapped.
+         *
+         * @param base page-aligned start of the region
+         * @param size size in bytes of the region (multiple of page size)
+         * @param flags permission flags for pages in the region
+         * @param type what backs the pages in this region
+         * @return ENONE on success, EEXISTS if the new region overlaps an
+         * existing one, ENOMEM if no memory was available.
+         */
+        int addRegion(void *base, size_t size, int flags, Region::Type type);
+
+        /**
+         * @brief Removes the range [base, base + size) from every region it
+         * overlaps, splitting regions as needed. Does not unmap any pages.
+         *
+         * @param base start of the range to remove
+         * @param size size in bytes of the range to remove
+         * @return ENONE on success, ENOMEM if a region needed splitting and no
+         * memory was available; the regions are then left unchanged.
+         */
+        int removeRegion(void *base, size_t size);
+
+        /**
+         * @brief Replaces this address space's regions with copies of the
+         * regions of `other`.
+         *
+         * @param other address space to copy regions from
+         * @return ENONE on success, ENOMEM if no memory was available
+         */
+        int copyRegions(const AddressSpace &other);
+
+        /**
+         * @param addr address to look up
+         * @return the region containing `addr`, or nullptr if there is none
+         */
+        Region *findRegion(const void *addr) const;
+
+        /**
+         * @return the region with the lowest address, or nullptr. Regions
+         * are kept sorted by address and linked through `Region::next`.
+         */
+        Region *firstRegion() const;
+
     private:
         physaddr_t topLevelTable;
 
         int id;
+
+        unsigned long asid;
+
+        Region *regions;
+
+        void clearRegions();
     };
 
 };
 
-#endif
\ No newline at end of file
+#endif
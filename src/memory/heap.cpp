@@ -1,344 +1,473 @@
-
 #include "heap.h"
 #include "mmap.h"
 #include "pageallocator.h"
 #include "util/string.h"
-#include "../containers/math.h"
+#include "types/status.h"
 #include <cstdint>
 #include "util/log.h"
 
-unsigned long *heap;
-unsigned long *linked_list_start = nullptr; // Actually last block in heap, but start of ll
-unsigned long *search_start = nullptr;      // Set at start of search, don't maintain
-unsigned long *search_previous = nullptr;   // Must maintain for search
-unsigned long *search_current = nullptr;    // Must maintain for search
-unsigned long *heap_end = nullptr;
-// unsigned long num_free_blocks;
+#define ALLOCATED 1UL
+#define DECOMMITTED 2UL // Free block whose interior pages may be unmapped
+#define TAG_FLAGS (ALLOCATED | DECOMMITTED)
+
+// Free lists are indexed by the position of the size's leading bit (first
+// level) and the SL_BITS bits that follow it (second level).
+#define FL_COUNT 48
+#define SL_BITS 2
+#define SL_COUNT (1 << SL_BITS)
+
+/**
+ * @brief Layout of the start of a free block. Allocated blocks only keep the
+ * header word; the links overlap the payload.
+ */
+struct free_block
+{
+  unsigned long header;
+  free_block *next;
+  free_block *prev;
+};
+
+static unsigned long *heap = nullptr;     // Prologue footer, first word of the heap
+static unsigned long *heap_end = nullptr; // First byte after the epilogue header
+static unsigned long heap_dynamic = 0;    // Start of pages mapped by the heap itself
+static unsigned long heap_limit = 0;      // End of the address range reserved for the heap
+
+static unsigned long free_bytes = 0;                // Total size of all free blocks
+static unsigned long fl_bitmap = 0;                 // Bit n set if any list in free_lists[n] is non-empty
+static unsigned long sl_bitmap[FL_COUNT];           // Bit m of entry n set if free_lists[n][m] is non-empty
+static free_block *free_lists[FL_COUNT][SL_COUNT];
+
+static inline unsigned long blk_size(unsigned long *blk)
+{
+  return blk[0] & ~TAG_FLAGS;
+}
 
-void init_heap(void *heap_ptr, unsigned long mem_size)
+static inline bool blk_used(unsigned long *blk)
 {
-  linked_list_start = nullptr;
-  search_start = nullptr;
-  search_previous = nullptr;
-  search_current = nullptr;
-  int overhead_adj_size = mem_size - (WORD_SIZE * OVERHEAD);
-  heap = (unsigned long *)heap_ptr;
-  heap[0] = overhead_adj_size / SIZE_T_SIZE; // Header size var
-  heap[1] = (unsigned long)nullptr;
-  heap[2] = 0; // Header flag var
-  heap[(mem_size / SIZE_T_SIZE) - 2] = heap[0];
-  heap[(mem_size / SIZE_T_SIZE) - 1] = heap[1];
-  linked_list_start = search_start = search_current = heap;
-  // num_free_blocks = 1;
-  heap_end = &heap[(mem_size / SIZE_T_SIZE)];
+  return blk[0] & ALLOCATED;
 }
 
-unsigned long next_power_of_2(unsigned long n)
+static inline unsigned long *blk_next(unsigned long *blk)
 {
-  unsigned count = 0;
-  // First n in the below condition
-  // is for the case where n is 0
-  if (n && !(n & (n - 1)))
-  {
-    return n;
-  }
-  while (n != 0)
-  {
-    n >>= 1;
-    count += 1;
-  }
-  return 1 << count;
+  return (unsigned long *)((char *)blk + blk_size(blk));
 }
 
-void expand_heap(unsigned long size)
+static inline unsigned long *blk_prev(unsigned long *blk)
 {
-  physaddr_t new_frame;
-  unsigned long adj_size = next_power_of_2(size);
-  if (size <= 4096)
-  { // Min size
-    new_frame = kernel::memory::pageAllocator.reserve(4096);
-  }
-  else
-  {
-    new_frame = kernel::memory::pageAllocator.reserve(adj_size);
-  }
-  kernel::memory::map_region(heap_end, adj_size, new_frame, kernel::memory::PAGE_RW);
+  return (unsigned long *)((char *)blk - (blk[-1] & ~TAG_FLAGS)); // blk[-1] is the previous block's footer
+}
+
+static inline void set_tags(unsigned long *blk, unsigned long size, unsigned long flag)
+{
+  blk[0] = size | flag;
+  ((unsigned long *)((char *)blk + size))[-1] = size | flag;
+}
+
+static inline unsigned long page_up(unsigned long addr)
+{
+  return (addr + kernel::memory::page_size - 1) & ~(kernel::memory::page_size - 1);
+}
 
-  heap_end = heap_end + adj_size;
-  rebuild_list(search_current);
+static inline unsigned long page_down(unsigned long addr)
+{
+  return addr & ~(kernel::memory::page_size - 1);
 }
 
-unsigned long *split_blk(unsigned long size, unsigned long *blk_to_split)
+static inline void mapping(unsigned long size, int &fl, int &sl)
 {
-  unsigned long *return_block = blk_to_split;
-  unsigned long *split_block = blk_to_split + (size / SIZE_T_SIZE) + OVERHEAD; // Current address + size + overhead to get address of new block
+  fl = 63 - __builtin_clzl(size);
+  sl = (size >> (fl - SL_BITS)) & (SL_COUNT - 1);
+}
 
-  split_block[0] = blk_to_split[0] - (size / SIZE_T_SIZE) - OVERHEAD; // Set header size
-  split_block[1] = blk_to_split[1];                                   // What ever blk_to_split points to, split block now points to
-  split_block[2] = 0;                                                 // Flag
-  split_block[split_block[0] + OVERHEAD - 2] = split_block[0];        // Set footer size
-  split_block[split_block[0] + OVERHEAD - 1] = 0;                     // Set footer flag
+static void insert_free(unsigned long *blk)
+{
+  int fl, sl;
+  mapping(blk_size(blk), fl, sl);
+  free_block *b = (free_block *)blk;
+  b->prev = nullptr;
+  b->next = free_lists[fl][sl];
+  if (b->next)
+  {
+    b->next->prev = b;
+  }
+  free_lists[fl][sl] = b;
+  free_bytes += blk_size(blk);
+  fl_bitmap |= 1UL << fl;
+  sl_bitmap[fl] |= 1UL << sl;
+}
 
-  // Maintain Linked list pointers
-  if (search_previous && search_previous[1])
+static void remove_free(unsigned long *blk)
+{
+  int fl, sl;
+  mapping(blk_size(blk), fl, sl);
+  free_block *b = (free_block *)blk;
+  if (b->prev)
   {
-    search_previous[1] = (unsigned long)split_block;
+    b->prev->next = b->next;
   }
-  if (blk_to_split == linked_list_start)
+  else
   {
-    linked_list_start = split_block;
+    free_lists[fl][sl] = b->next;
   }
-  if (blk_to_split == search_previous)
+  if (b->next)
   {
-    search_previous = split_block;
+    b->next->prev = b->prev;
   }
-  if (blk_to_split == search_current)
+  free_bytes -= blk_size(blk);
+  if (!free_lists[fl][sl])
   {
-    search_current = split_block;
+    sl_bitmap[fl] &= ~(1UL << sl);
+    if (!sl_bitmap[fl])
+    {
+      fl_bitmap &= ~(1UL << fl);
+    }
   }
-  return_block[0] = size / SIZE_T_SIZE;                           // Set header size
-  return_block[1] = 0;                                            // Reset next address to null
-  return_block[2] = 1;                                            // Set flag
-  return_block[return_block[0] + OVERHEAD - 2] = return_block[0]; // Setting footer size
-  return_block[return_block[0] + OVERHEAD - 1] = 1;               // Setting footer flag
-
-  return &return_block[3];
 }
 
-unsigned long *find_fit(unsigned long size)
+/**
+ * @brief Finds a free block of at least `size` bytes. The request is rounded
+ * up to the next second-level class so that any block in the first non-empty
+ * list at or above that class is guaranteed to fit. If that fails, the list
+ * holding `size` itself is scanned, since it may contain a block that fits.
+ */
+static unsigned long *find_free(unsigned long size)
 {
-  search_start = search_current;
-  do
+  int fl, sl;
+  mapping(size, fl, sl);
+  mapping(size + (1UL << (fl - SL_BITS)) - 1, fl, sl);
+  if (fl < FL_COUNT)
   {
-    if ((search_current[0] * SIZE_T_SIZE) == size + OVERHEAD)
-    { // Block is correct size, use it
-      unsigned long *return_block = search_current;
-      if (search_previous && search_current != search_start)
+    unsigned long sl_map = sl_bitmap[fl] & (~0UL << sl);
+    if (!sl_map && fl + 1 < FL_COUNT)
+    {
+      unsigned long fl_map = fl_bitmap & (~0UL << (fl + 1));
+      if (fl_map)
       {
-        search_previous[1] = return_block[1]; // Update linked list, removing search next as it is now in use
+        fl = __builtin_ctzl(fl_map);
+        sl_map = sl_bitmap[fl];
       }
-      search_current = (unsigned long *)return_block[1]; // Go to next block for future calls
-      return_block[2] = 1;                               // Set flag
-      return_block[return_block[0] + 2] = 1;             // Set footer flag
-      return &return_block[3];                           // Return address of start of useable memory
     }
-    else if ((search_current[0] * SIZE_T_SIZE) > ALIGN(size + ((OVERHEAD + 1) * SIZE_T_SIZE * 2)))
-    { // Block is oversized, split
-      return split_blk(size, search_current);
-    }
-    else if (search_current[1])
-    { // Block is not right size and not end of linked list, iterate
-      search_previous = search_current;
-      search_current = (unsigned long *)search_current[1];
+    if (sl_map)
+    {
+      return (unsigned long *)free_lists[fl][__builtin_ctzl(sl_map)];
     }
-    else
-    { // End of list, go to start and iterate
-      search_previous = search_current;
-      search_current = linked_list_start;
+  }
+
+  mapping(size, fl, sl);
+  for (free_block *b = free_lists[fl][sl]; b; b = b->next)
+  {
+    if (blk_size((unsigned long *)b) >= size)
+    {
+      return (unsigned long *)b;
     }
-  } while (search_previous && search_start != search_current && search_current < heap_end);
+  }
+  return nullptr;
+}
 
-  return nullptr; // Failed to find block big enough
+/**
+ * @brief Marks `blk` as free, merges it with free neighbours and inserts the
+ * result into the free lists. `blk` must not be on a free list.
+ *
+ * @param committed if not null, receives the number of bytes in the merged
+ * block which came from blocks that had not been decommitted
+ * @return the merged block
+ */
+static unsigned long *coalesce(unsigned long *blk, unsigned long *committed = nullptr)
+{
+  unsigned long size = blk_size(blk);
+  unsigned long flags = blk[0] & DECOMMITTED;
+  unsigned long fresh = flags ? 0 : size;
+  unsigned long *next = blk_next(blk);
+  if (!blk_used(next))
+  {
+    remove_free(next);
+    size += blk_size(next);
+    flags |= next[0] & DECOMMITTED;
+    fresh += (next[0] & DECOMMITTED) ? 0 : blk_size(next);
+  }
+  if (!(blk[-1] & ALLOCATED))
+  {
+    unsigned long *prev = blk_prev(blk);
+    remove_free(prev);
+    size += blk_size(prev);
+    flags |= prev[0] & DECOMMITTED;
+    fresh += (prev[0] & DECOMMITTED) ? 0 : blk_size(prev);
+    blk = prev;
+  }
+  set_tags(blk, size, flags);
+  insert_free(blk);
+  if (committed)
+  {
+    *committed = fresh;
+  }
+  return blk;
 }
 
-void *rmalloc(unsigned long size)
+/**
+ * @brief Marks the first `size` bytes of `blk` as allocated. If enough space
+ * is left over for another block, the remainder is split off and freed.
+ */
+static void split_blk(unsigned long *blk, unsigned long size)
 {
-  unsigned long blk_size = ALIGN(size);
-  unsigned long *block = find_fit(blk_size);
-  if (!block)
-  { // Out of space, request more;
-    expand_heap(size);
-    block = find_fit(blk_size); // Try allocation again
-    if (!block)
+  unsigned long total = blk_size(blk);
+  if (total - size >= MIN_BLOCK_SIZE)
+  {
+    unsigned long flags = blk[0] & DECOMMITTED;
+    set_tags(blk, size, ALLOCATED);
+    unsigned long *rest = blk_next(blk);
+    set_tags(rest, total - size, flags);
+    coalesce(rest);
+  }
+  else
+  {
+    set_tags(blk, total, ALLOCATED);
+  }
+}
+
+/**
+ * @brief Maps every unmapped page in [start, end). A decommitted free block
+ * keeps the pages holding its header and footer, so only the pages about to
+ * be handed out, plus the header of any remainder, need to be committed.
+ *
+ * @return true on success, false if there was not enough memory
+ */
+static bool commit(unsigned long start, unsigned long end)
+{
+  using namespace kernel::memory;
+  unsigned long page = page_down(start);
+  while (page < end)
+  {
+    unsigned long run = page;
+    while (run < end && getPageFrame((void *)run) == 0)
     {
-      return nullptr; // Panic, mem expansion failed
+      run += page_size;
+    }
+    if (run > page && allocate_region((void *)page, run - page, PAGE_RW) != ENONE)
+    {
+      return false;
     }
+    page = run + page_size;
   }
-  return block;
+  return true;
 }
 
-void rebuild_list(unsigned long *current)
+/**
+ * @brief Commits the part of free block `blk` that an allocation of `size`
+ * bytes would use.
+ */
+static bool commit_blk(unsigned long *blk, unsigned long size)
 {
-  unsigned long *ll_cur, *ll_prev;
-  ll_prev = linked_list_start; // First block in ll
-  ll_cur = heap;               // First block in physical mem
+  if (!(blk[0] & DECOMMITTED))
+  {
+    return true;
+  }
+  unsigned long start = (unsigned long)blk;
+  unsigned long end = start + size + sizeof(free_block);
+  unsigned long blk_end = start + blk_size(blk);
+  return commit(start, end < blk_end ? end : blk_end);
+}
 
-  // Rebuild ll WATCHME High computation since traversing whole ll?
-  while (ll_cur < heap_end)
+/**
+ * @brief Hands memory in a newly freed block back to the page allocator. If
+ * the block is at the top of the heap and larger than HEAP_TRIM_THRESHOLD,
+ * the heap is shrunk so that HEAP_TRIM_KEEP bytes remain free. Otherwise, if
+ * at least HEAP_DECOMMIT_THRESHOLD bytes of still-committed memory were just
+ * merged into the block, every whole page inside it is unmapped. Pages the
+ * heap did not map itself are never released.
+ *
+ * @param blk a free block
+ * @param committed bytes of the block which may still be committed
+ */
+static void release_blk(unsigned long *blk, unsigned long committed)
+{
+  using namespace kernel::memory;
+  unsigned long start = (unsigned long)blk;
+  if (blk_next(blk) == heap_end - 1 && blk_size(blk) > HEAP_TRIM_THRESHOLD)
   {
-    while (ll_cur[2] != 0)
+    unsigned long new_end = page_up(start + HEAP_TRIM_KEEP + WORD_SIZE);
+    if (new_end < heap_dynamic)
     {
-      ll_cur = ll_cur + ll_cur[0] + OVERHEAD; // Start of next block
+      new_end = heap_dynamic;
     }
-    if (ll_cur != linked_list_start)
+    // The new footer and epilogue may land on a decommitted page
+    if (new_end < (unsigned long)heap_end && commit(new_end - 2 * WORD_SIZE, new_end))
     {
-      if (ll_cur == current)
-      { // Set previous and current
-        search_previous = ll_prev;
-        search_current = ll_cur;
-      }
-      ll_prev[1] = (unsigned long)ll_cur;
-      ll_prev = ll_cur;
-      ll_cur = ll_cur + ll_cur[0] + OVERHEAD; // Start of next block
-    }
-    else
-    {
-      break; // End of heap
+      remove_free(blk);
+      free_region((void *)new_end, (unsigned long)heap_end - new_end);
+      heap_end = (unsigned long *)new_end;
+      heap_end[-1] = ALLOCATED;
+      set_tags(blk, new_end - WORD_SIZE - start, blk[0] & DECOMMITTED);
+      insert_free(blk);
+      return;
     }
   }
-  if (current == linked_list_start && linked_list_start[1])
-  { // Edge Case when linked_list_start is current, move current to next node
-    search_previous = linked_list_start;
-    search_current = (unsigned long *)linked_list_start[1];
+
+  if (committed < HEAP_DECOMMIT_THRESHOLD)
+  {
+    return;
+  }
+  unsigned long first = page_up(start + sizeof(free_block));
+  unsigned long last = page_down(start + blk_size(blk) - WORD_SIZE);
+  if (first < heap_dynamic)
+  {
+    first = heap_dynamic;
+  }
+  if (last > first)
+  {
+    free_region((void *)first, last - first);
+    blk[0] |= DECOMMITTED;
+    blk_next(blk)[-1] |= DECOMMITTED;
   }
-  ll_prev[1] = 0; // End of list, set next addr to 0 so list doesn't loop
 }
 
-void merge(unsigned long *current)
+static inline unsigned long block_size_for(unsigned long size)
 {
-  unsigned long *previous, *next, *ll_cur, *ll_prev;
-  previous = next = nullptr;
+  unsigned long blk_size = ALIGN(size + OVERHEAD);
+  return blk_size < MIN_BLOCK_SIZE ? MIN_BLOCK_SIZE : blk_size;
+}
 
-  if (current != heap)
+void init_heap(void *heap_ptr, unsigned long mem_size, unsigned long reserve_size)
+{
+  unsigned long start = ALIGN((unsigned long)heap_ptr);
+  unsigned long end = ((unsigned long)heap_ptr + mem_size) & ~(BLOCK_ALIGN - 1);
+  heap_dynamic = page_up(end);
+  heap_limit = page_down((unsigned long)heap_ptr + reserve_size);
+
+  fl_bitmap = 0;
+  free_bytes = 0;
+  for (int i = 0; i < FL_COUNT; i++)
   {
-    if ((current - 1)[0] == 0)
-    { // Previous block is free, merge
-      previous = (current - ((current - 2)[0] + OVERHEAD));
+    sl_bitmap[i] = 0;
+    for (int j = 0; j < SL_COUNT; j++)
+    {
+      free_lists[i][j] = nullptr;
     }
   }
 
-  if ((current + current[0] + OVERHEAD + 2)[0] == 0 && (current + current[0] + OVERHEAD + 2) < heap_end)
-  { // Next block is free, merge  NOTE 2 to get to the flag on the next block
-    next = (current + current[0] + OVERHEAD);
-  }
+  heap = (unsigned long *)start;
+  heap_end = (unsigned long *)end;
+  heap[0] = ALLOCATED;     // Prologue footer
+  heap_end[-1] = ALLOCATED; // Epilogue header
 
-  if (previous)
-  {                                                    // Merge previous
-    previous[0] = previous[0] + current[0] + OVERHEAD; // Set size
-    current[1] = 0;                                    // NOTE Not required, just cleans up heap for debugging
+  unsigned long *first = heap + 1;
+  set_tags(first, end - start - OVERHEAD, 0);
+  insert_free(first);
+}
 
-    if (current == linked_list_start)
-    { // Need to maintain, otherwise rebuild will fail, all other pointers set in rebuild
-      linked_list_start = previous;
-    }
+void expand_heap(unsigned long size)
+{
+  using namespace kernel::memory;
 
-    if (current == search_current)
-    {
-      search_current = previous;
-    }
+  // A free block at the top of the heap will be merged with the new memory
+  unsigned long tail = (heap_end[-2] & ALLOCATED) ? 0 : (heap_end[-2] & ~TAG_FLAGS);
+  unsigned long adj_size = page_up(((size > tail) ? size - tail : 0) + OVERHEAD);
+  if ((unsigned long)heap_end + adj_size > heap_limit)
+  {
+    kernelLog(LogLevel::WARNING, "Kernel heap reservation exhausted");
+    return;
+  }
 
-    previous[previous[0] + OVERHEAD - 2] = previous[0]; // Set footer size, flag is already set
-    current = previous;                                 // Set this incase next is also being merged
-    // num_free_blocks--;
+  // The new memory does not need to be physically contiguous
+  if (allocate_region(heap_end, adj_size, PAGE_RW) != ENONE)
+  {
+    kernelLog(LogLevel::WARNING, "Failed to expand kernel heap by %i bytes", adj_size);
+    return;
   }
 
-  if (next)
-  {                                               // Merge next
-    current[0] = current[0] + next[0] + OVERHEAD; // Set size
-    next[1] = 0;                                  // NOTE Not required, just cleans up heap
-    if (next == linked_list_start)
-    { // Need to maintain, otherwise rebuild will fail, all other pointers set in rebuild
-      linked_list_start = current;
-    }
+  // The old epilogue header becomes the header of the new free block
+  unsigned long *blk = heap_end - 1;
+  heap_end = (unsigned long *)((char *)heap_end + adj_size);
+  set_tags(blk, adj_size, 0);
+  heap_end[-1] = ALLOCATED;
+  coalesce(blk);
+}
 
-    if (next == search_current)
+void *rmalloc(unsigned long size)
+{
+  unsigned long blk_size = block_size_for(size);
+  unsigned long *block = find_free(blk_size);
+  if (!block)
+  { // Out of space, request more;
+    expand_heap(blk_size);
+    block = find_free(blk_size); // Try allocation again
+    if (!block)
     {
-      search_current = current;
+      return nullptr; // Panic, mem expansion failed
     }
-
-    current[current[0] + OVERHEAD - 2] = current[0]; // Set footer size, flag is already set
-    // num_free_blocks--;
   }
-
-  if (previous || next)
-  { // Only rebuild list if merge occured
-    rebuild_list(current);
+  if (!commit_blk(block, blk_size))
+  {
+    return nullptr;
   }
+  remove_free(block);
+  split_blk(block, blk_size);
+  return block + 1;
 }
 
 void rfree(void *ptr)
 {
-  unsigned long *blk_free = (unsigned long *)ptr - 3; // Subtract 3 to get from start of data field to start of header
-  blk_free[2] = 0;                                    // Set flag
-  blk_free[blk_free[0] + OVERHEAD - 1] = 0;           // Set footer flag
-  // Insert into linked list
-  if (search_previous)
-  {                                   // Already a list, insert
-    blk_free[1] = search_previous[1]; // search_previous-> blk_free -> search_next
-    search_previous[1] = (unsigned long)blk_free;
-  }
-  else
-  { // No list, start one
-    search_previous = linked_list_start;
-    search_previous[1] = (unsigned long)blk_free;
+  if (!ptr)
+  {
+    return;
   }
-  search_current = blk_free;
-
-  // num_free_blocks++;
-  // Check for merging
-  merge(blk_free);
+  unsigned long *blk_free = (unsigned long *)ptr - 1; // Step back from start of data field to the header
+  unsigned long committed;
+  unsigned long *blk = coalesce(blk_free, &committed);
+  release_blk(blk, committed);
 }
 
 void *realloc(void *ptr, unsigned long new_size)
 {
-  unsigned long *return_blk, *blk_old;
-  int flag = 1;                       // Tries mem expansion twice before failing
-  blk_old = (unsigned long *)ptr - 3; // Subtract 3 to get from start of data field to start of header
-
   if (!ptr)
   { // If pointer null, same as malloc
     return rmalloc(new_size);
   }
-  else if (blk_old[0] > new_size + OVERHEAD + 1)
-  { // Need to shrink and free FIXME Potential Fragmentation, merge not called on freed block
-    return_blk = split_blk(new_size, blk_old);
-    rebuild_list(return_blk);
-    return return_blk;
-  }
-  // Need to expand, check if space in current heap
-  do
-  { // CLEANME
-    return_blk = find_fit(new_size);
-    if (return_blk)
-    { // Found space in current heap, copy data;
-      memcpy(return_blk, ptr, blk_old[0]);
-    }
-    // No mem left, expand
-    expand_heap(new_size);
-    flag--;
-  } while (flag >= 0);
 
-  return NULL; // Panic, expansion failed
-}
+  unsigned long *blk_old = (unsigned long *)ptr - 1;
+  unsigned long old_size = blk_size(blk_old);
+  unsigned long blk_size = block_size_for(new_size);
 
-/*Debug Fuctions*/
+  if (blk_size <= old_size)
+  { // Shrink in place, freeing the tail
+    split_blk(blk_old, blk_size);
+    return ptr;
+  }
 
-uint64_t xorshift64(uint64_t state) // Psuedo Random Number Generator
-{
-  uint64_t x = state;
-  x ^= x << 13;
-  x ^= x >> 7;
-  x ^= x << 17;
-  return state = x;
-}
+  unsigned long *next = blk_next(blk_old);
+  if (!blk_used(next) && old_size + ::blk_size(next) >= blk_size && commit_blk(next, blk_size - old_size))
+  { // Grow in place by absorbing the next block
+    remove_free(next);
+    set_tags(blk_old, old_size + ::blk_size(next), ALLOCATED | (next[0] & DECOMMITTED));
+    split_blk(blk_old, blk_size);
+    return ptr;
+  }
 
-uint64_t randinrange(uint64_t lower, uint64_t upper, uint64_t rand)
-{
-  return (rand % (upper - lower + 1)) + lower;
+  void *return_blk = rmalloc(new_size);
+  if (!return_blk)
+  {
+    return nullptr; // Panic, expansion failed
+  }
+  memcpy(return_blk, ptr, old_size - OVERHEAD);
+  rfree(ptr);
+  return return_blk;
 }
 
-void debug_bounds_check(unsigned long *a, unsigned long *b, uint64_t size_b)
+void heap_info(unsigned long *used, unsigned long *free, unsigned long *largest_free)
 {
-  unsigned long *blk1 = a - 3;
-  unsigned long *blk2 = b - 3;
-  if (blk1 == blk2)
+  // Everything between the prologue footer and epilogue header is a block
+  *used = (unsigned long)heap_end - (unsigned long)heap - 2 * WORD_SIZE - free_bytes;
+  *free = free_bytes;
+  *largest_free = 0;
+  if (fl_bitmap)
   {
-    return;
-  }
-  if (blk1 >= blk2 && blk1 < blk2 + size_b)
-  {
-    while (1)
+    int fl = 63 - __builtin_clzl(fl_bitmap);
+    int sl = 63 - __builtin_clzl(sl_bitmap[fl]);
+    for (free_block *b = free_lists[fl][sl]; b; b = b->next)
     {
+      if (blk_size((unsigned long *)b) > *largest_free)
+      {
+        *largest_free = blk_size((unsigned long *)b);
+      }
     }
   }
 }
@@ -9,129 +9,106 @@ Author: Sam Lane
 #include <cstdint>
 
 #define WORD_SIZE sizeof(unsigned long) // Either 4 or 8, we're 64 bit so 8
-#define OVERHEAD 5
-#define ALIGN(size) (((size) + (WORD_SIZE - 1)) & ~(WORD_SIZE - 1))
-#define SIZE_T_SIZE (ALIGN(sizeof(unsigned long))) // header size
+#define OVERHEAD (2 * WORD_SIZE)        // Header and footer tags
+#define MIN_BLOCK_SIZE (4 * WORD_SIZE)  // Tags plus free-list links
+#define BLOCK_ALIGN 16
+#define ALIGN(size) (((size) + (BLOCK_ALIGN - 1)) & ~(BLOCK_ALIGN - 1))
+
+// Free space at the top of the heap beyond which the heap is shrunk, and the
+// amount of free space left behind when it is, so that memory freed and
+// reallocated in bursts is not repeatedly unmapped and mapped again
+#ifndef HEAP_TRIM_THRESHOLD
+#define HEAP_TRIM_THRESHOLD (256 * 1024)
+#endif
+#ifndef HEAP_TRIM_KEEP
+#define HEAP_TRIM_KEEP (64 * 1024)
+#endif
+
+// Amount of newly freed memory which must join a free block before the pages
+// inside it are unmapped
+#ifndef HEAP_DECOMMIT_THRESHOLD
+#define HEAP_DECOMMIT_THRESHOLD (128 * 1024)
+#endif
 
 /**
- * @brief Initialize heap at the memory address pointed to by  
- * heap_ptr of size mem_size. Sets initial block up with flags
- * and all pointers used for traversing memory.
- * 
- * @param heap_ptr 
- * @param mem_size 
+ * @brief Initialize heap at the memory address pointed to by
+ * heap_ptr of size mem_size. The region is bracketed by an allocated
+ * prologue footer and epilogue header so that coalescing never has to
+ * check the heap bounds, and the remainder becomes a single free block.
+ *
+ * Every block carries a boundary tag at each end holding its size in bytes
+ * with the low bit set when the block is in use. Free blocks additionally
+ * store next/prev pointers to other free blocks of a similar size.
+ *
+ * The first mem_size bytes must already be mapped, and are never unmapped.
+ * The heap grows into, and shrinks back out of, the rest of the
+ * reserve_size bytes starting at heap_ptr, which nothing else may use.
+ *
+ * @param heap_ptr
+ * @param mem_size
+ * @param reserve_size
  */
-void init_heap(void *heap_ptr, unsigned long mem_size);
+void init_heap(void *heap_ptr, unsigned long mem_size, unsigned long reserve_size);
 
 /**
- * @brief Expands avaliable heap memory by allocating and mapping
- * additional pages. 
- * 
- * @param size 
+ * @brief Expands avaliable heap memory by mapping just enough additional
+ * pages at the end of the heap to fit a block of `size` bytes once merged
+ * with the last block, if that is free.
+ *
+ * @param size
  */
 void expand_heap(unsigned long size);
 
 /**
- * @brief Iterates through all of memory, adding free blocks
- * to the linked list for later allocation.
- * 
- * @param current 
- */
-void rebuild_list(unsigned long *current);
-
-/**
- * @brief Checks previous and next blocks of memory to see
- * if they are free. If they are, a single block is created
- * from them and rebuild list is called to fix the linked
- * list pointers.
- * 
- * @param current 
- */
-void merge(unsigned long *current);
-
-/**
- * @brief Frees memory by setting the free bit flag and calling
- * merge to check surrounding blocks of memory. Ptr is the pointer
- * to writable memory, so it is subtracted by 3 to get to the start
- * of the memory block header. 
- * 
- * @param ptr 
+ * @brief Frees memory by clearing the in-use bit of the block's boundary
+ * tags. Adjacent free blocks are unlinked from their free lists and merged
+ * in constant time before the result is inserted into the appropriate
+ * free list.
+ *
+ * Pages are handed back to the page allocator when enough memory becomes
+ * free, either by shrinking the heap or by unmapping whole pages inside a
+ * large free block (see HEAP_TRIM_THRESHOLD and HEAP_DECOMMIT_THRESHOLD).
+ * Such pages are mapped again when the block is next allocated.
+ *
+ * @param ptr
  */
 void rfree(void *ptr);
 
 /**
- * @brief Allocates a memory block of size +5 for the header and footer
- * info. The header bytes are, in order, size of the block in bytes, pointer to
- * the next free block if in linked list, and in use flag. The footer
- * bytes are, in order, size of block in bytes and in use flag. Returns a ptr
- * to the user of the fourth byte in the allocated block, which is the first
- * free byte of memory after the header. 
- * 
- * @param size 
- * @return void* 
+ * @brief Allocates a block with at least `size` usable bytes. Free blocks
+ * are kept in segregated lists indexed by a coarse (power of two) and a
+ * fine (quarter power of two) size class, with bitmaps recording which lists
+ * are non-empty. Finding a suitable block is therefore a couple of bit scans
+ * rather than a walk of the heap. Oversized blocks are split, and the heap is
+ * expanded if no block is large enough.
+ *
+ * @param size
+ * @return void* pointer to 16-byte aligned memory, or nullptr on failure
  */
 void *rmalloc(unsigned long size);
 
 /**
  * @brief Takes a pointer to allocated memory. If pointer is null, operates the
- * same as malloc. Otherwise, it either shrinks the allocated memory to fit in 
- * the new size, copying all memory up to the new size. If new size is larger, 
- * the heap is checked for a block of sufficient size, which is then allocated 
- * and the memory copied. If no block of sufficient size is found, memory is 
- * expanded and then the allocation is made. 
- * 
- * @param ptr 
- * @param new_size 
- * @return void* 
+ * same as malloc. If the new size fits in the current block, the block is
+ * shrunk in place and the tail is freed. If the block that follows is free
+ * and large enough, the allocation grows in place. Otherwise a new block is
+ * allocated, the data copied, and the old block freed.
+ *
+ * @param ptr
+ * @param new_size
+ * @return void*
  */
 void *realloc(void *ptr, unsigned long new_size);
 
 /**
- * @brief Helper function used when expanding memory. Finds the next power
- * of 2 larger than n and returns it. 
- * 
- * @param n 
- * @return unsigned long 
- */
-unsigned long next_power_of_2(unsigned long n);
-
-/**
- * @brief Takes a large block of memory and splits it into two smaller
- * blocks, one of size size, and the other with the remaining size minus
- * the overhead for the header and footers. The block of size size is 
- * returned
- * 
- * @param size 
- * @param blk_to_split 
- * @return unsigned long* 
+ * @brief Reports how the heap is being used. Sizes include boundary tags.
+ * Runs in time proportional to the number of free blocks of the largest
+ * size class.
+ *
+ * @param used receives the total size of allocated blocks
+ * @param free receives the total size of free blocks
+ * @param largest_free receives the size of the largest free block
  */
-unsigned long *split_blk(unsigned long size, unsigned long *blk_to_split);
-
-/**
- * @brief Find fit traverses memory looking for free blocks of sufficient 
- * size. If a block is oversized, it is split into two via split_blk. 
- * Find_fit iterates over all free blocks of memory in the linked list 
- * until the starting free block is reached. It then fails to find a block
- * of sufficient size and returns a nullptr.
- * 
- * @param size 
- * @return unsigned long* 
- */
-unsigned long *find_fit(unsigned long size);
-
-
-
-// Testing functions KILLME
-#define SIZE 30
-
-void debug_bounds_check(unsigned long *a, unsigned long *b, uint64_t size_b);
-uint64_t xorshift64(uint64_t state);
-uint64_t randinrange(uint64_t lower, uint64_t upper, uint64_t rand);
-
-struct test_struct
-{
-    unsigned long *pointer;
-    int size;
-};
+void heap_info(unsigned long *used, unsigned long *free, unsigned long *largest_free);
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,84 @@
+#include "kernelstack.h"
+#include "mmap.h"
+#include "types/status.h"
+#include "util/log.h"
+#include "kernel.h"
+
+using namespace kernel::memory;
+
+#ifndef KERNEL_STACK_SIZE
+#define KERNEL_STACK_SIZE (1UL << 16)
+#endif
+
+/*
+ * Kernel stacks live in their own 1 GiB window of kernel address space,
+ * starting 12 GiB above the beginning of high memory, right after the slab
+ * window. Each slot is a guard page followed by the stack itself.
+ */
+static const unsigned long stackWindowOffset = 0x300000000;
+
+static const unsigned long stackWindowSize = 0x40000000;
+
+static inline unsigned long stackWindowBase()
+{
+    return (unsigned long)&__high_mem + stackWindowOffset;
+}
+
+KernelStackPool kernel::memory::kernelStacks(KERNEL_STACK_SIZE);
+
+KernelStackPool::KernelStackPool(unsigned long stackSize)
+    : stackSize((stackSize + page_size - 1) & ~(page_size - 1)), freeList(nullptr), nextUnused(0), activeStacks(0)
+{
+}
+
+void *KernelStackPool::allocate()
+{
+    if (freeList != nullptr)
+    {
+        void *bottom = freeList;
+        freeList = *(void **)bottom;
+        activeStacks++;
+        return bottom + stackSize;
+    }
+
+    unsigned long slotSize = stackSize + page_size;
+    if ((nextUnused + 1) * slotSize > stackWindowSize)
+    {
+        kernelLog(LogLevel::WARNING, "Kernel stack window exhausted");
+        return nullptr;
+    }
+
+    // The guard page at the start of the slot is never mapped
+    void *bottom = (void *)(stackWindowBase() + nextUnused * slotSize + page_size);
+    if (allocate_region(bottom, stackSize, PAGE_RW) != ENONE)
+    {
+        return nullptr;
+    }
+    nextUnused++;
+    activeStacks++;
+    return bottom + stackSize;
+}
+
+void KernelStackPool::free(void *top)
+{
+    if (top == nullptr)
+    {
+        return;
+    }
+
+    // The bottom of the stack is the part least likely to still be in use
+    void *bottom = top - stackSize;
+    *(void **)bottom = freeList;
+    freeList = bottom;
+    activeStacks--;
+}
+
+unsigned long KernelStackPool::getStackSize() const
+{
+    return stackSize;
+}
+
+unsigned long KernelStackPool::getActiveStacks() const
+{
+    return activeStacks;
+}
@@ -0,0 +1,74 @@
+#ifndef KERNEL_KERNELSTACK_H
+#define KERNEL_KERNELSTACK_H
+
+namespace kernel::memory
+{
+
+    /**
+     * @brief Hands out kernel stacks from a dedicated window of kernel
+     * address space. Every stack has an unmapped guard page below it, so
+     * overflowing a stack faults instead of corrupting the memory beneath it.
+     * Freed stacks stay mapped and are reused before new ones are carved out.
+     */
+    class KernelStackPool
+    {
+    public:
+        /**
+         * @brief Constructs an empty pool. No memory is reserved until the
+         * first call to `allocate()`, so pools may be declared as globals.
+         *
+         * @param stackSize size in bytes of each stack, rounded up to a whole
+         * number of pages
+         */
+        KernelStackPool(unsigned long stackSize);
+
+        /**
+         * @brief Reserves one stack.
+         *
+         * @return the top of the new stack, i.e. its initial stack pointer,
+         * or nullptr if no memory or address space was left
+         */
+        void *allocate();
+
+        /**
+         * @brief Returns a stack to the pool. The stack may still be in use
+         * until the next call to `allocate()`, which lets a process free its
+         * own stack on its way out.
+         *
+         * @param top pointer returned by `allocate()`
+         */
+        void free(void *top);
+
+        unsigned long getStackSize() const;
+
+        /**
+         * @return the number of stacks currently handed out
+         */
+        unsigned long getActiveStacks() const;
+
+    private:
+        unsigned long stackSize;
+
+        /**
+         * @brief Freed stacks, linked through the lowest word of each
+         */
+        void *freeList;
+
+        /**
+         * @brief Index of the first slot in the window that has never been
+         * handed out. Slots are only mapped when first needed.
+         */
+        unsigned long nextUnused;
+
+        unsigned long activeStacks;
+    };
+
+    /**
+     * @brief Pool all process kernel stacks come from. Their size is set at
+     * build time with `KERNEL_STACK_SIZE`.
+     */
+    extern KernelStackPool kernelStacks;
+
+}
+
+#endif
@@ -6,12 +6,18 @@
 
 using namespace kernel::memory;
 
-MemoryMap::MemoryMap() : mapSize(0)
+MemoryMap::MemoryMap(MemoryRegion *storage, unsigned long capacity) 
+    : capacity(capacity), mapSize(0), map(storage)
 {}
 
+unsigned long MemoryMap::capacityFor(unsigned long placements)
+{
+    return 2 * placements + 2;
+}
+
 int MemoryMap::place(MemoryType type, unsigned long location, unsigned long size)
 {
-    if(mapSize <= capacity - 2)
+    if(mapSize + 2 <= capacity)
     {
         insert(type, location, size);
         int i = 0;
@@ -136,9 +136,24 @@ public:
     };
 
     /**
-     * @brief Default constructor.
+     * @brief Constructs an empty memory map which keeps its regions in
+     * caller-provided storage. Each call to `place` needs at most two more
+     * entries, so `capacity` should be at least twice the number of calls
+     * that will be made, plus two.
+     * 
+     * @param storage array of at least `capacity` regions
+     * @param capacity number of regions that fit in `storage`
+     */
+    MemoryMap(MemoryRegion *storage, unsigned long capacity);
+
+    /**
+     * @brief Computes the capacity a memory map needs to hold the result of
+     * `placements` calls to `place`.
+     * 
+     * @param placements number of regions that will be placed
+     * @return the number of MemoryRegion entries to allocate
      */
-    MemoryMap();
+    static unsigned long capacityFor(unsigned long placements);
 
     /**
      * @brief Places a new region into the memory map. Regions with higher type
@@ -170,9 +185,9 @@ public:
 private:
 
     /**
-     * @brief Maximum number of different regions that can be inside a memory map
+     * @brief Maximum number of different regions that can be inside this map
      */
-    static const unsigned long capacity = 16;
+    unsigned long capacity;
 
     /**
      * @brief Current number of regions inside this memory map. Any objects
@@ -183,7 +198,7 @@ private:
     /**
      * @brief Array of memory regions describing the layout of an address space.
      */
-    MemoryRegion map[capacity];
+    MemoryRegion *map;
 
     /**
      * @brief Modifies the map array starting at `index` to ensure that
@@ -1,11 +1,36 @@
 #include "mmap.h"
 #include "pageallocator.h"
+#include "types/status.h"
 #include "util/log.h"
 
 using namespace kernel::memory;
 
 int idCounter = 1;
 
+/**
+ * @brief Number of frames `allocate_region` reserves from the page allocator
+ * at once.
+ */
+static const unsigned long regionBatchSize = 32;
+
+physaddr_t kernel::memory::getZeroPage()
+{
+    static physaddr_t zeroPage = PageAllocator::NOMEM;
+    if (zeroPage == PageAllocator::NOMEM)
+    {
+        zeroPage = pageAllocator.reserve(page_size);
+        if (zeroPage != PageAllocator::NOMEM)
+        {
+            unsigned long *p = (unsigned long *)physicalToLinear(zeroPage);
+            for (unsigned long i = 0; i < page_size / sizeof(*p); i++)
+            {
+                p[i] = 0;
+            }
+        }
+    }
+    return zeroPage;
+}
+
 AddressSpace *kernel::memory::createAddressSpace()
 {
     physaddr_t frame = pageAllocator.reserve(getBlockSize(0));
@@ -20,27 +45,159 @@ AddressSpace *kernel::memory::createAddressSpace()
     return obj;
 }
 
-void kernel::memory::destoryAddressSpace(AddressSpace &addressSpace)
+int kernel::memory::map_region(void *addr, size_t size, physaddr_t frame, int flags)
 {
-    // kernelLog(LogLevel::WARNING, "destroyAddressSpace(id = %i) called: not implemented.", addressSpace.getId());
-    //  TODO
+    // Use large blocks wherever the address, frame and remaining size line up
+    const unsigned long blockSize = getBlockSize(1);
+    unsigned long p = 0;
+    beginTLBBatch();
+    while (p < size)
+    {
+        if (((unsigned long)addr + p) % blockSize == 0 && (frame + p) % blockSize == 0 && size - p >= blockSize)
+        {
+            setPageEntry(1, addr + p, frame + p, flags);
+            p += blockSize;
+        }
+        else
+        {
+            setPageEntry(0, addr + p, frame + p, flags);
+            p += page_size;
+        }
+    }
+    endTLBBatch();
+    return 0;
 }
 
-int kernel::memory::map_region(void *addr, size_t size, physaddr_t frame, int flags)
+int kernel::memory::map_region(void *addr, const FrameExtent *extents, unsigned long count, int flags)
 {
-    // TODO: Make this more efficient. Map larger blocks when possible.
-    for (unsigned long p = 0; p < size; p += getBlockSize(0))
+    int status = 0;
+    beginTLBBatch();
+    for (unsigned long i = 0; i < count && status == 0; i++)
     {
-        setPageEntry(0, addr + p, frame + p, flags);
+        status = map_region(addr, extents[i].size, extents[i].frame, flags);
+        addr += extents[i].size;
     }
-    return 0;
+    endTLBBatch();
+    return status;
+}
+
+int kernel::memory::allocate_region(void *addr, size_t size, int flags)
+{
+    const unsigned long blockSize = getBlockSize(1);
+    size = (size + page_size - 1) & ~(page_size - 1);
+    physaddr_t frames[regionBatchSize];
+    FrameExtent extents[regionBatchSize];
+    unsigned long done = 0;
+    beginTLBBatch();
+    while (done < size)
+    {
+        // Back whole aligned blocks with contiguous memory when it is available
+        void *next = addr + done;
+        if ((unsigned long)next % blockSize == 0 && size - done >= blockSize)
+        {
+            physaddr_t frame = pageAllocator.reserveContiguous(blockSize);
+            if (frame != PageAllocator::NOMEM)
+            {
+                map_region(next, blockSize, frame, flags);
+                done += blockSize;
+                continue;
+            }
+        }
+
+        // Otherwise fill up to the next block boundary with individual pages
+        unsigned long boundary = ((unsigned long)next / blockSize + 1) * blockSize - (unsigned long)addr;
+        unsigned long pages = ((boundary < size ? boundary : size) - done) / page_size;
+        while (pages > 0)
+        {
+            unsigned long want = pages < regionBatchSize ? pages : regionBatchSize;
+            unsigned long count = pageAllocator.reserveBatch(want, 0, frames);
+
+            // Merge physically adjacent frames so they are mapped as one extent
+            unsigned long extentCount = 0;
+            for (unsigned long i = 0; i < count; i++)
+            {
+                if (extentCount > 0 && extents[extentCount - 1].frame + extents[extentCount - 1].size == frames[i])
+                {
+                    extents[extentCount - 1].size += page_size;
+                }
+                else
+                {
+                    extents[extentCount].frame = frames[i];
+                    extents[extentCount].size = page_size;
+                    extentCount++;
+                }
+            }
+            map_region(addr + done, extents, extentCount, flags);
+            done += count * page_size;
+            pages -= count;
+
+            if (count < want)
+            {
+                free_region(addr, done);
+                endTLBBatch();
+                return ENOMEM;
+            }
+        }
+    }
+    endTLBBatch();
+    return ENONE;
+}
+
+void kernel::memory::free_region(void *addr, size_t size)
+{
+    const unsigned long blockSize = getBlockSize(1);
+    unsigned long p = 0;
+    beginTLBBatch();
+    while (p < size)
+    {
+        // Whole blocks are released without splitting them into pages first
+        if (((unsigned long)addr + p) % blockSize == 0 && size - p >= blockSize)
+        {
+            for (unsigned long q = 0; q < blockSize; q += page_size)
+            {
+                physaddr_t frame = getPageFrame(addr + p + q);
+                if (frame != 0 && frame != getZeroPage())
+                {
+                    pageAllocator.release(frame);
+                }
+            }
+            clearEntry(1, addr + p);
+            p += blockSize;
+            continue;
+        }
+
+        physaddr_t frame = getPageFrame(addr + p);
+        if (frame != 0)
+        {
+            clearEntry(0, addr + p);
+            if (frame != getZeroPage())
+            {
+                pageAllocator.release(frame);
+            }
+        }
+        p += page_size;
+    }
+    endTLBBatch();
 }
 
 physaddr_t kernel::memory::unmap_region(void *addr, size_t size)
 {
-    for (unsigned long p = 0; p < size; p += getBlockSize(0))
+    const unsigned long blockSize = getBlockSize(1);
+    unsigned long p = 0;
+    beginTLBBatch();
+    while (p < size)
     {
-        clearEntry(0, addr + p);
+        if (((unsigned long)addr + p) % blockSize == 0 && size - p >= blockSize)
+        {
+            clearEntry(1, addr + p);
+            p += blockSize;
+        }
+        else
+        {
+            clearEntry(0, addr + p);
+            p += page_size;
+        }
     }
+    endTLBBatch();
     return 0;
 }
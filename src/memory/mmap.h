@@ -33,7 +33,31 @@ namespace kernel::memory
          * @brief When set, page can contain executable code. When clear, code
          * in this page cannot be executed.
          */
-        PAGE_EXE = (1 << 2)
+        PAGE_EXE = (1 << 2),
+
+        /**
+         * @brief When set, the page's frame is shared with other address
+         * spaces on purpose. Such pages stay shared across fork rather than
+         * being made copy-on-write.
+         */
+        PAGE_SHARED = (1 << 3)
+    };
+
+    /**
+     * @brief A run of physically contiguous memory used to back part of a
+     * virtual memory region.
+     */
+    struct FrameExtent
+    {
+        /**
+         * @brief Physical address of the first frame in this extent
+         */
+        physaddr_t frame;
+
+        /**
+         * @brief Size in bytes of this extent (should be multiple of page size)
+         */
+        size_t size;
     };
 
     /**
@@ -44,15 +68,48 @@ namespace kernel::memory
      */
     AddressSpace *createAddressSpace();
 
+    /**
+     * @brief Creates a copy-on-write duplicate of the active address space.
+     * Only page tables are copied: every writable user page is made read-only
+     * in both address spaces and copied when either side first writes to it.
+     *
+     * Implementation of this function is platform-dependent.
+     *
+     * @return a pointer to a newly allocated AddressSpace object, or nullptr
+     * if there was not enough memory
+     */
+    AddressSpace *cloneAddressSpace();
+
     /**
      * @brief Frees all physical memory associated with the given address space.
      * The address space will no longer be usable, and the caller is expected to
      * delete the relevant AddressSpace object.
      *
+     * User frames are released rather than freed, so pages still shared
+     * copy-on-write with another address space are kept. If the address space
+     * is currently loaded, its tables are reclaimed the next time
+     * `loadAddressSpace` is called.
+     *
+     * Implementation of this function is platform-dependent.
+     *
      * @param addressSpace object describing the address space to destory.
      */
     void destoryAddressSpace(AddressSpace &addressSpace);
 
+    /**
+     * @brief Counts the pages backed by frames in an address space, which
+     * need not be loaded. Pages mapped to the shared zero page are not
+     * counted.
+     *
+     * Implementation of this function is platform-dependent.
+     *
+     * @param addressSpace address space to inspect
+     * @param resident receives the number of pages backed by a frame
+     * @param shared receives how many of those frames are also mapped
+     * somewhere else, or are not owned by the page allocator
+     */
+    void countResidentPages(AddressSpace &addressSpace, unsigned long &resident, unsigned long &shared);
+
     /**
      * @brief Switches to the provided address space. Calls to `map_region` and
      * other such functions will modify only the currently active address space
@@ -62,6 +119,52 @@ namespace kernel::memory
      */
     void loadAddressSpace(AddressSpace &addressSpace);
 
+    /**
+     * @return the address space most recently passed to `loadAddressSpace`,
+     * or nullptr if none has been loaded.
+     */
+    AddressSpace *getActiveAddressSpace();
+
+    /**
+     * @brief Gets a kernel pointer through which the physical frame `frame`
+     * can be accessed directly, regardless of whether (or where) it is mapped
+     * in any address space.
+     *
+     * Implementation of this function is platform-dependent.
+     *
+     * @param frame physical address to access
+     * @return linear address aliasing `frame`
+     */
+    void *physicalToLinear(physaddr_t frame);
+
+    /**
+     * @brief Gets a page frame filled with zeroes which is shared between all
+     * address spaces. It must only ever be mapped read-only, and never freed.
+     *
+     * @return physical address of the zero page, or PageAllocator::NOMEM if it
+     * could not be allocated
+     */
+    physaddr_t getZeroPage();
+
+    /**
+     * @brief Starts a batch of mapping changes. Until the matching call to
+     * `endTLBBatch`, stale translations are invalidated without waiting for
+     * each invalidation to complete, so a batch of changes costs a single
+     * barrier. Addresses changed inside a batch must not be accessed until the
+     * batch ends. Batches may be nested.
+     *
+     * Implementation of this function is platform-dependent.
+     */
+    void beginTLBBatch();
+
+    /**
+     * @brief Ends a batch started by `beginTLBBatch`, waiting for all
+     * invalidations issued during the batch to complete.
+     *
+     * Implementation of this function is platform-dependent.
+     */
+    void endTLBBatch();
+
     /**
      * @brief Map the region of memory starting at `addr` to frames starting at `frame`.
      * @param addr linear address of the region to map
@@ -72,6 +175,43 @@ namespace kernel::memory
      */
     int map_region(void *addr, size_t size, physaddr_t frame, int flags);
 
+    /**
+     * @brief Map the region of memory starting at `addr` to a list of frame
+     * extents. The extents are mapped back-to-back in the order given, so the
+     * region does not need to be physically contiguous.
+     * @param addr linear address of the region to map
+     * @param extents list of physical extents backing the region
+     * @param count number of elements in `extents`
+     * @param flags permission flags for the pages to map
+     * @return 0 upon success, nonzero upon failure
+     */
+    int map_region(void *addr, const FrameExtent *extents, unsigned long count, int flags);
+
+    /**
+     * @brief Reserves enough page frames to back the region starting at
+     * `addr` and maps them. Frames are reserved one page at a time in
+     * batches, so the allocation does not depend on finding a single large
+     * contiguous block, and each frame can later be released individually.
+     * @param addr linear address of the region to map
+     * @param size size in bytes of the region (rounded up to a multiple of
+     * page size)
+     * @param flags permission flags for the pages to map
+     * @return ENONE upon success, ENOMEM if physical memory ran out. On
+     * failure nothing is left mapped.
+     */
+    int allocate_region(void *addr, size_t size, int flags);
+
+    /**
+     * @brief Unmaps the region starting at `addr` and drops a reference to
+     * every frame that was mapped inside it, freeing frames which are no
+     * longer shared. Should only be used on
+     * regions built by `allocate_region` or backed on demand. The shared zero
+     * page is unmapped but not freed.
+     * @param addr linear address of the region to free
+     * @param size size in bytes of the region
+     */
+    void free_region(void *addr, size_t size);
+
     /**
      * @brief Unmap the region of memory starting at `addr`. Does not free any
      * frames; this must be done by caller.
@@ -125,6 +265,17 @@ namespace kernel::memory
      */
     void setPageEntry(int level, void *page, physaddr_t frame, int flags);
 
+    /**
+     * @brief Makes instructions written to memory at `addr` visible to
+     * instruction fetches. Needed before executing code copied into a page.
+     *
+     * Implementation of this function is platform-dependent.
+     *
+     * @param addr start of the written memory
+     * @param size size in bytes of the written memory
+     */
+    void syncInstructionCache(void *addr, size_t size);
+
     /**
      * @brief Writes a new translation table entry for the virtual memory region
      * starting at `page`. The new table is backed by `table`.
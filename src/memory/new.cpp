@@ -1,32 +1,60 @@
 #include "new.h"
 #include "heap.h"
+#include "slab.h"
+
+/*
+ * Small allocations are served by the slab size classes; anything larger
+ * than the biggest size class (or any request made when the slab window
+ * cannot grow) falls back to the general-purpose heap.
+ */
+static void *allocate(size_t size)
+{
+    void *ptr = kernel::memory::slabAllocate(size);
+    if (ptr == nullptr)
+    {
+        ptr = rmalloc(size);
+    }
+    return ptr;
+}
+
+static void release(void *ptr)
+{
+    if (ptr == nullptr)
+    {
+        return;
+    }
+    if (!kernel::memory::slabFree(ptr))
+    {
+        rfree(ptr);
+    }
+}
 
 void *operator new(size_t size)
 {
-    return rmalloc(size);
+    return allocate(size);
 }
 
 void operator delete(void *ptr)
 {
-    rfree(ptr);
+    release(ptr);
 }
 
 void *operator new[](size_t size)
 {
-    return rmalloc(size);
+    return allocate(size);
 }
 
 void operator delete[](void *ptr)
 {
-    return rfree(ptr);
+    release(ptr);
 }
 
 void operator delete(void *ptr, unsigned long sz)
 {
-    return rfree(ptr);
+    release(ptr);
 }
 
 void operator delete[](void *ptr, unsigned long sz)
 {
-    return rfree(ptr);
-}
\ No newline at end of file
+    release(ptr);
+}
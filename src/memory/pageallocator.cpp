@@ -1,5 +1,7 @@
 #include "pageallocator.h"
+#include "mmap.h"
 #include "util/math.h"
+#include "util/string.h"
 
 using namespace kernel::memory;
 
@@ -24,6 +26,13 @@ PageAllocator::PageAllocator()
     this->blockSize = 0;
     this->offset = 0;
     this->freeBlockCount = 0;
+    this->totalBlockCount = 0;
+    this->pendingCount = 0;
+    this->zeroedCount = 0;
+    for (int i = 0; i < availListSize; i++)
+    {
+        pendingList[i] = nullptr;
+    }
 }
 
 PageAllocator::PageAllocator(MemoryMap &map, void *mapBase, unsigned long blockSize)
@@ -33,12 +42,18 @@ PageAllocator::PageAllocator(MemoryMap &map, void *mapBase, unsigned long blockS
     this->blockMapSize = mapSize(map, blockSize);
     this->offset = 0;
     this->freeBlockCount = 0;
+    this->pendingCount = 0;
+    this->zeroedCount = 0;
     this->maxKVal = llog2(blockMapSize / sizeof(Block));
     for (int i = 0; i <= maxKVal; i++)
     {
         availList[i].linkf = &availList[i];
         availList[i].linkb = &availList[i];
     }
+    for (int i = 0; i < availListSize; i++)
+    {
+        pendingList[i] = nullptr;
+    }
 
     for (int i = 0; i < blockMapSize / sizeof(Block); i++)
     {
@@ -58,47 +73,274 @@ PageAllocator::PageAllocator(MemoryMap &map, void *mapBase, unsigned long blockS
         {
             insert(location / blockSize, 0);
             location += blockSize;
-            freeBlockCount++;
         }
     }
+    totalBlockCount = freeBlockCount;
 }
 
 physaddr_t PageAllocator::reserve(unsigned long size)
 {
     unsigned long k = llog2((size - 1) / blockSize + 1);
-    for (unsigned long j = k; j <= maxKVal; j++)
+    physaddr_t location;
+    if (reserveBatch(1, k, &location) != 1)
+    {
+        return NOMEM;
+    }
+    return location;
+}
+
+physaddr_t PageAllocator::reserveContiguous(unsigned long size)
+{
+    physaddr_t location = reserve(size);
+    if (location == NOMEM)
+    {
+        return NOMEM;
+    }
+
+    unsigned long index = (location - offset) / blockSize;
+    unsigned long count = 1UL << blockMap[index].kval;
+    for (unsigned long i = 0; i < count; i++)
+    {
+        blockMap[index + i] = Block(nullptr, nullptr, 0, Block::RESERVED);
+        blockMap[index + i].refcount = 1;
+    }
+    return location;
+}
+
+unsigned long PageAllocator::reserveBatch(unsigned long count, unsigned long order, physaddr_t out[])
+{
+    unsigned long n = 0;
+    while (n < count && pendingList[order] != nullptr)
+    {
+        Block *block = pendingList[order];
+        pendingList[order] = block->linkf;
+        block->tag = Block::RESERVED;
+        block->refcount = 1;
+        pendingCount -= 1UL << order;
+        freeBlockCount -= 1UL << order;
+        out[n++] = offset + (block - blockMap) * blockSize;
+    }
+
+    while (n < count)
     {
-        if (availList[j].linkf != &availList[j])
+        unsigned long j = order;
+        while (j <= maxKVal && availList[j].linkf == &availList[j])
+        {
+            j++;
+        }
+        if (j > maxKVal)
         {
-            Block *block = availList[j].linkb;
-            availList[j].linkb = block->linkb;
-            availList[j].linkb->linkf = &availList[j];
-            block->tag = Block::RESERVED;
-            while (j > k)
+            if (pendingCount == 0 && zeroedCount == 0)
             {
-                j--;
-                Block *buddy = block + (1UL << j);
-                *buddy = Block(&availList[j], &availList[j], j, Block::FREE);
-                block->kval = j;
-                availList[j].linkb = buddy;
-                availList[j].linkf = buddy;
+                break;
             }
-            unsigned long index = block - blockMap;
-            freeBlockCount -= 1UL << k;
-            return offset + index * blockSize;
+            else if (pendingCount == 0)
+            {
+                // Give up the pre-cleared pages before failing
+                freeBatch(zeroedCount, zeroedPool);
+                zeroedCount = 0;
+            }
+            flush();
+            continue;
+        }
+
+        Block *block = availList[j].linkb;
+        availList[j].linkb = block->linkb;
+        availList[j].linkb->linkf = &availList[j];
+        unsigned long index = block - blockMap;
+
+        // Carve as many blocks of `order` out of this one as are still needed
+        unsigned long pieces = 1UL << (j - order);
+        unsigned long take = (count - n < pieces) ? (count - n) : pieces;
+        for (unsigned long i = 0; i < take; i++)
+        {
+            unsigned long pieceIndex = index + (i << order);
+            blockMap[pieceIndex] = Block(nullptr, nullptr, order, Block::RESERVED);
+            blockMap[pieceIndex].refcount = 1;
+            out[n++] = offset + pieceIndex * blockSize;
+        }
+        freeBlockCount -= take << order;
+
+        // Return the remainder as the largest aligned blocks that fit. None of
+        // these can have a free buddy, so no merging is needed.
+        unsigned long pos = take;
+        while (pos < pieces)
+        {
+            unsigned long k = order + __builtin_ctzl(pos);
+            link(index + (pos << order), k);
+            pos += 1UL << (k - order);
         }
     }
-    return NOMEM;
+    return n;
+}
+
+physaddr_t PageAllocator::reserveZeroed()
+{
+    if (zeroedCount > 0)
+    {
+        zeroedCount--;
+        return zeroedPool[zeroedCount];
+    }
+
+    physaddr_t location;
+    if (reserveBatch(1, 0, &location) != 1)
+    {
+        return NOMEM;
+    }
+    zero(location);
+    return location;
+}
+
+unsigned long PageAllocator::refillZeroed(unsigned long budget)
+{
+    unsigned long count = 0;
+    while (count < budget && zeroedCount < zeroedPoolSize)
+    {
+        // Reserve outside the pool: when memory runs short, reserveBatch
+        // hands the pool back to the allocator
+        physaddr_t location;
+        if (reserveBatch(1, 0, &location) != 1)
+        {
+            break;
+        }
+        zero(location);
+        zeroedPool[zeroedCount++] = location;
+        count++;
+    }
+    return count;
 }
 
 unsigned long PageAllocator::free(physaddr_t location)
 {
     unsigned long index = (location - offset) / blockSize;
     unsigned long k = blockMap[index].kval;
+    blockMap[index].refcount = 0;
     insert(index, k);
     return (1UL << k) * blockSize;
 }
 
+void PageAllocator::freeBatch(unsigned long count, const physaddr_t locations[])
+{
+    for (unsigned long i = 0; i < count; i++)
+    {
+        Block *block = &blockMap[(locations[i] - offset) / blockSize];
+        block->tag = Block::PENDING;
+        block->refcount = 0;
+        block->linkb = nullptr;
+        block->linkf = pendingList[block->kval];
+        pendingList[block->kval] = block;
+        pendingCount += 1UL << block->kval;
+        freeBlockCount += 1UL << block->kval;
+    }
+    if (pendingCount >= pendingLimit)
+    {
+        flush();
+    }
+}
+
+void PageAllocator::flush()
+{
+    for (unsigned long k = 0; k < availListSize; k++)
+    {
+        while (pendingList[k] != nullptr)
+        {
+            Block *block = pendingList[k];
+            pendingList[k] = block->linkf;
+            freeBlockCount -= 1UL << k;
+            insert(block - blockMap, k);
+        }
+    }
+    pendingCount = 0;
+}
+
+unsigned long PageAllocator::addReference(physaddr_t location)
+{
+    Block *block = lookup(location);
+    if (block == nullptr || block->refcount == 0)
+    {
+        return 0;
+    }
+    return ++block->refcount;
+}
+
+unsigned long PageAllocator::release(physaddr_t location)
+{
+    Block *block = lookup(location);
+    if (block == nullptr || block->refcount == 0)
+    {
+        return 0;
+    }
+    block->refcount--;
+    if (block->refcount == 0)
+    {
+        freeBatch(1, &location);
+    }
+    return block->refcount;
+}
+
+unsigned long PageAllocator::getRefCount(physaddr_t location) const
+{
+    Block *block = lookup(location);
+    return block == nullptr ? 0 : block->refcount;
+}
+
+unsigned long PageAllocator::getTotalPages() const
+{
+    return totalBlockCount;
+}
+
+unsigned long PageAllocator::getFreePages() const
+{
+    return freeBlockCount;
+}
+
+unsigned long PageAllocator::getZeroedPages() const
+{
+    return zeroedCount;
+}
+
+void PageAllocator::getFreeBlocks(unsigned long counts[], unsigned long orders) const
+{
+    for (unsigned long k = 0; k < orders; k++)
+    {
+        counts[k] = 0;
+        if (k >= availListSize)
+        {
+            continue;
+        }
+        if (k <= maxKVal)
+        {
+            for (const Block *p = availList[k].linkf; p != &availList[k]; p = p->linkf)
+            {
+                counts[k]++;
+            }
+        }
+        for (const Block *p = pendingList[k]; p != nullptr; p = p->linkf)
+        {
+            counts[k]++;
+        }
+    }
+}
+
+void PageAllocator::zero(physaddr_t location)
+{
+    memset(physicalToLinear(location), 0, blockSize);
+}
+
+PageAllocator::Block *PageAllocator::lookup(physaddr_t location) const
+{
+    if (location < offset)
+    {
+        return nullptr;
+    }
+    unsigned long index = (location - offset) / blockSize;
+    if (index >= blockMapSize / sizeof(Block))
+    {
+        return nullptr;
+    }
+    return &blockMap[index];
+}
+
 void PageAllocator::insert(unsigned long index, unsigned long k)
 {
     freeBlockCount += 1UL << k;
@@ -118,6 +360,11 @@ void PageAllocator::insert(unsigned long index, unsigned long k)
             index = buddyIndex;
         }
     }
+    link(index, k);
+}
+
+void PageAllocator::link(unsigned long index, unsigned long k)
+{
     Block *p = availList[k].linkf;
     blockMap[index] = Block(p, &availList[k], k, Block::FREE);
     p->linkb = &blockMap[index];
@@ -125,11 +372,11 @@ void PageAllocator::insert(unsigned long index, unsigned long k)
 }
 
 PageAllocator::Block::Block()
-    : linkf(nullptr), linkb(nullptr), kval(0), tag(RESERVED)
+    : linkf(nullptr), linkb(nullptr), kval(0), tag(RESERVED), refcount(0)
 {
 }
 
-PageAllocator::Block::Block(Block *linkf, Block *linkb, unsigned long kval, unsigned long tag)
-    : linkf(linkf), linkb(linkb), kval(kval), tag(tag)
+PageAllocator::Block::Block(Block *linkf, Block *linkb, unsigned int kval, unsigned int tag)
+    : linkf(linkf), linkb(linkb), kval(kval), tag(tag), refcount(0)
 {
 }
@@ -47,33 +47,166 @@ public:
     physaddr_t reserve(unsigned long size);
 
     /**
-     * @brief 
-     * @param location 
-     * @return 
+     * @brief Reserves a contiguous chunk of memory like `reserve`, but marks
+     * every page inside it as a separate block. The pages can then be shared
+     * and freed individually, while the chunk as a whole can be mapped using
+     * large translation blocks.
+     *
+     * @param size the minimum number of bytes to reserve
+     * @return the physical address of the first page, or NOMEM upon failure.
+     */
+    physaddr_t reserveContiguous(unsigned long size);
+
+    /**
+     * @brief Reserves up to `count` blocks of `2^order` pages each in a single
+     * pass over the free lists. Blocks released by `freeBatch` are handed out
+     * first, and a larger block is carved into as many pieces as are needed
+     * rather than being split one level at a time for every reservation.
+     * The blocks are not necessarily contiguous with each other.
+     *
+     * @param count the number of blocks to reserve
+     * @param order log2 of the number of pages in each block
+     * @param out array of at least `count` elements which receives the
+     * physical address of each block
+     * @return the number of blocks actually reserved. If this is less than
+     * `count`, the allocator ran out of memory; the caller is responsible for
+     * releasing the blocks that were reserved.
+     */
+    unsigned long reserveBatch(unsigned long count, unsigned long order, physaddr_t out[]);
+
+    /**
+     * @brief Reserves a single page filled with zeroes. Pages are taken from
+     * a pool cleared ahead of time by `refillZeroed`; if the pool is empty,
+     * the page is cleared on the spot.
+     *
+     * The physical memory window must be mapped before this is called.
+     *
+     * @return the physical address of the page, or NOMEM upon failure.
+     */
+    physaddr_t reserveZeroed();
+
+    /**
+     * @brief Clears up to `budget` pages and adds them to the pool used by
+     * `reserveZeroed`. Meant to be called when there is nothing more urgent
+     * to do, so that the cost of clearing pages is kept off the paths which
+     * need them. Pooled pages are handed back if memory runs out.
+     *
+     * @param budget the maximum number of pages to clear
+     * @return the number of pages added to the pool
+     */
+    unsigned long refillZeroed(unsigned long budget);
+
+    /**
+     * @brief Frees a block previously returned by `reserve` or `reserveBatch`,
+     * merging it with its buddies immediately.
+     *
+     * @param location the physical address of the block to free
+     * @return the size in bytes of the freed block
      */
     unsigned long free(physaddr_t location);
 
+    /**
+     * @brief Frees many blocks at once. Merging with buddies is deferred until
+     * the number of pending blocks passes a threshold, a reservation cannot
+     * otherwise be satisfied, or `flush` is called. Pending blocks can be
+     * handed straight back out by later reservations of the same order.
+     *
+     * @param count the number of blocks to free
+     * @param locations the physical address of each block to free
+     */
+    void freeBatch(unsigned long count, const physaddr_t locations[]);
+
+    /**
+     * @brief Merges every block released by `freeBatch` back into the free
+     * lists.
+     */
+    void flush();
+
+    /**
+     * @brief Adds a reference to a block, for instance when its frame is
+     * mapped into a second address space. Blocks start with one reference
+     * when they are reserved.
+     *
+     * @param location the physical address of the block
+     * @return the new reference count, or 0 if `location` is not managed by
+     * this allocator
+     */
+    unsigned long addReference(physaddr_t location);
+
+    /**
+     * @brief Drops a reference to a block, freeing it (as if by `freeBatch`)
+     * once no references remain. Locations outside of memory managed by this
+     * allocator, or blocks without any references (e.g. reserved regions such
+     * as the ramfs), are ignored.
+     *
+     * @param location the physical address of the block
+     * @return the remaining reference count
+     */
+    unsigned long release(physaddr_t location);
+
+    /**
+     * @param location the physical address of a block
+     * @return the number of references to the block at `location`
+     */
+    unsigned long getRefCount(physaddr_t location) const;
+
+    /**
+     * @return the number of pages managed by this allocator
+     */
+    unsigned long getTotalPages() const;
+
+    /**
+     * @return the number of pages not currently reserved
+     */
+    unsigned long getFreePages() const;
+
+    /**
+     * @return the number of pages held in the pool used by `reserveZeroed`
+     */
+    unsigned long getZeroedPages() const;
+
+    /**
+     * @brief Counts the free blocks of each size. Blocks waiting to be merged
+     * by `flush` are counted at their current size.
+     *
+     * @param counts receives the number of free blocks of 2^k pages at index k
+     * @param orders the number of elements in `counts`
+     */
+    void getFreeBlocks(unsigned long counts[], unsigned long orders) const;
+
 private:
 
     class Block
     {
     public:
 
-        static const unsigned long RESERVED = 0;
+        static const unsigned int RESERVED = 0;
 
-        static const unsigned long FREE = 1;
+        static const unsigned int FREE = 1;
+
+        /**
+         * @brief Block has been freed by `freeBatch`, but has not yet been
+         * merged with its buddy. Linked through `linkf` on `pendingList`.
+         */
+        static const unsigned int PENDING = 2;
 
         Block();
         
-        Block(Block *linkf, Block *linkb, unsigned long kval, unsigned long tag);
+        Block(Block *linkf, Block *linkb, unsigned int kval, unsigned int tag);
 
         Block *linkb;
 
         Block *linkf;
 
-        unsigned long kval;
+        unsigned int kval;
+
+        unsigned int tag;
 
-        unsigned long tag;
+        /**
+         * @brief Number of references to a reserved block. Zero for free
+         * blocks, and for memory which was never handed out by the allocator.
+         */
+        unsigned int refcount;
 
     };
 
@@ -84,8 +217,30 @@ private:
      */
     static const int availListSize = 32;
 
+    /**
+     * @brief Number of pages which may sit on the pending lists before they
+     * are merged back into `availList`.
+     */
+    static const unsigned long pendingLimit = 512;
+
+    /**
+     * @brief Maximum number of pages kept in `zeroedPool`.
+     */
+    static const unsigned long zeroedPoolSize = 64;
+
     Block availList[availListSize];
 
+    Block *pendingList[availListSize];
+
+    unsigned long pendingCount;
+
+    /**
+     * @brief Reserved pages which have already been cleared
+     */
+    physaddr_t zeroedPool[zeroedPoolSize];
+
+    unsigned long zeroedCount;
+
     Block *blockMap;
 
     unsigned long blockMapSize;
@@ -98,6 +253,8 @@ private:
 
     unsigned long freeBlockCount;
 
+    unsigned long totalBlockCount;
+
     /**
      * @brief Inserts a new block into the appropriate linked list, performing
      * mergers with buddy blocks as needed.
@@ -107,6 +264,28 @@ private:
      */
     void insert(unsigned long index, unsigned long k);
 
+    /**
+     * @brief Adds a free block to the front of the list for `k`, without
+     * attempting to merge it.
+     *
+     * @param index
+     * @param k
+     */
+    void link(unsigned long index, unsigned long k);
+
+    /**
+     * @brief Fills the page at `location` with zeroes through the physical
+     * memory window.
+     */
+    void zero(physaddr_t location);
+
+    /**
+     * @brief Finds the block describing `location`.
+     *
+     * @return the block, or nullptr if `location` is outside the block map
+     */
+    Block *lookup(physaddr_t location) const;
+
 };
 
 extern PageAllocator pageAllocator;
@@ -0,0 +1,5 @@
+#include "pagesource.h"
+
+kernel::memory::PageSource::~PageSource()
+{
+}
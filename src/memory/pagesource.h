@@ -0,0 +1,29 @@
+#ifndef KERNEL_PAGESOURCE_H
+#define KERNEL_PAGESOURCE_H
+
+#include "util/hasrefcount.h"
+
+namespace kernel::memory
+{
+
+    /**
+     * @brief Supplies the initial contents of pages in a region that is
+     * filled on demand, such as a segment of a program image.
+     */
+    class PageSource : public HasRefcount
+    {
+    public:
+        virtual ~PageSource() = 0;
+
+        /**
+         * @brief Copies `size` bytes starting at `offset` in the source to
+         * `dest`, which is a kernel address.
+         *
+         * @return ENONE, or EIO if the range could not be read
+         */
+        virtual int read(unsigned long offset, void *dest, unsigned long size) const = 0;
+    };
+
+}
+
+#endif
@@ -0,0 +1,149 @@
+#include "sharedmemory.h"
+#include "addressspace.h"
+#include "pageallocator.h"
+#include "usercopy.h"
+#include "types/status.h"
+
+using namespace kernel::memory;
+
+SharedMemory::SharedMemory()
+    : size(0), extents(nullptr), extentCount(0)
+{
+}
+
+SharedMemory *SharedMemory::create(unsigned long size)
+{
+    size = (size + page_size - 1) & ~(page_size - 1);
+    if (size == 0)
+    {
+        return nullptr;
+    }
+
+    SharedMemory *segment = new SharedMemory();
+    if (segment == nullptr)
+    {
+        return nullptr;
+    }
+    segment->extents = new FrameExtent[size / page_size];
+    if (segment->extents == nullptr)
+    {
+        delete segment;
+        return nullptr;
+    }
+
+    while (segment->size < size)
+    {
+        physaddr_t frame = pageAllocator.reserveZeroed();
+        if (frame == PageAllocator::NOMEM)
+        {
+            delete segment;
+            return nullptr;
+        }
+
+        FrameExtent *last = segment->extentCount > 0 ? &segment->extents[segment->extentCount - 1] : nullptr;
+        if (last != nullptr && last->frame + last->size == frame)
+        {
+            last->size += page_size;
+        }
+        else
+        {
+            segment->extents[segment->extentCount].frame = frame;
+            segment->extents[segment->extentCount].size = page_size;
+            segment->extentCount++;
+        }
+        segment->size += page_size;
+    }
+    return segment;
+}
+
+SharedMemory::~SharedMemory()
+{
+    for (unsigned long i = 0; i < extentCount; i++)
+    {
+        for (unsigned long p = 0; p < extents[i].size; p += page_size)
+        {
+            pageAllocator.release(extents[i].frame + p);
+        }
+    }
+    delete[] extents;
+}
+
+unsigned long SharedMemory::getSize() const
+{
+    return size;
+}
+
+int SharedMemory::map(void *addr, int flags)
+{
+    if ((unsigned long)addr % page_size != 0 || !is_user_range(addr, size))
+    {
+        return EINVAL;
+    }
+
+    AddressSpace *addressSpace = getActiveAddressSpace();
+    if (addressSpace == nullptr)
+    {
+        return EINVAL;
+    }
+
+    flags |= PAGE_USER | PAGE_SHARED;
+    int status = addressSpace->addRegion(addr, size, flags, AddressSpace::Region::Type::SHARED);
+    if (status != ENONE)
+    {
+        return status;
+    }
+
+    // Each mapping holds its own references, dropped again by free_region
+    for (unsigned long i = 0; i < extentCount; i++)
+    {
+        for (unsigned long p = 0; p < extents[i].size; p += page_size)
+        {
+            pageAllocator.addReference(extents[i].frame + p);
+        }
+    }
+    return map_region(addr, extents, extentCount, flags);
+}
+
+kernel::fs::FileContext *SharedMemory::createContext()
+{
+    return new SharedMemoryContext(this);
+}
+
+SharedMemory::SharedMemoryContext::SharedMemoryContext(SharedMemory *segment)
+    : segment(segment)
+{
+    segment->addReference();
+}
+
+SharedMemory::SharedMemoryContext::~SharedMemoryContext()
+{
+    segment->removeReference();
+    if (segment->getRefCount() <= 0)
+    {
+        delete segment;
+    }
+}
+
+int SharedMemory::SharedMemoryContext::read(void *, int)
+{
+    return EIO;
+}
+
+int SharedMemory::SharedMemoryContext::write(const void *, int)
+{
+    return EIO;
+}
+
+int SharedMemory::SharedMemoryContext::map(void *addr, unsigned long offset, unsigned long size, int flags)
+{
+    if (offset != 0 || (size != 0 && size != segment->getSize()))
+    {
+        return EINVAL;
+    }
+    return segment->map(addr, flags);
+}
+
+kernel::fs::FileContext *SharedMemory::SharedMemoryContext::copy()
+{
+    return new SharedMemoryContext(segment);
+}
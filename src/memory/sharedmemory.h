@@ -0,0 +1,89 @@
+#ifndef KERNEL_SHAREDMEMORY_H
+#define KERNEL_SHAREDMEMORY_H
+
+#include "util/hasrefcount.h"
+#include "fs/filecontext.h"
+#include "mmap.h"
+
+namespace kernel::memory
+{
+
+    /**
+     * @brief A set of zero-filled frames which can be mapped into any number
+     * of address spaces at once. Processes refer to a segment through file
+     * descriptors; the segment lives as long as any of them is open.
+     *
+     * Every mapping of the segment holds its own reference to each frame, so
+     * the frames are only freed once the segment is gone and every mapping
+     * has been unmapped.
+     */
+    class SharedMemory : public HasRefcount
+    {
+    public:
+        /**
+         * @brief Creates a segment of at least `size` bytes, rounded up to
+         * a whole number of pages.
+         *
+         * @return a new segment, or nullptr if there was not enough memory
+         */
+        static SharedMemory *create(unsigned long size);
+
+        ~SharedMemory();
+
+        /**
+         * @return the size of the segment in bytes
+         */
+        unsigned long getSize() const;
+
+        /**
+         * @brief Maps the whole segment into the active address space.
+         *
+         * @param addr page-aligned address to map the segment at
+         * @param flags access flags for the mapped pages
+         * @return ENONE, EINVAL if the range is misaligned or outside user
+         * memory, EEXISTS if it overlaps an existing region, or ENOMEM
+         */
+        int map(void *addr, int flags);
+
+        kernel::fs::FileContext *createContext();
+
+    private:
+        SharedMemory();
+
+        unsigned long size;
+
+        /**
+         * @brief Runs of physically contiguous frames backing the segment,
+         * in address order
+         */
+        FrameExtent *extents;
+
+        unsigned long extentCount;
+
+        class SharedMemoryContext : public kernel::fs::FileContext
+        {
+        public:
+            SharedMemoryContext(SharedMemory *segment);
+
+            ~SharedMemoryContext();
+
+            int read(void *buffer, int n);
+
+            int write(const void *buffer, int n);
+
+            /**
+             * @brief Segments can only be mapped whole, so `offset` must be
+             * 0 and `size` either 0 or the size of the segment.
+             */
+            int map(void *addr, unsigned long offset, unsigned long size, int flags);
+
+            FileContext *copy();
+
+        private:
+            SharedMemory *segment;
+        };
+    };
+
+}
+
+#endif
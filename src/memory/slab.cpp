@@ -0,0 +1,314 @@
+#include "slab.h"
+#include "mmap.h"
+#include "pageallocator.h"
+#include "util/math.h"
+#include "util/log.h"
+#include "kernel.h"
+
+using namespace kernel::memory;
+
+/*
+ * Slabs live in their own 1 GiB window of kernel address space, starting 8 GiB
+ * above the beginning of high memory. Keeping them apart from the heap means
+ * any pointer can be classified as slab/heap with a single range check.
+ */
+static const unsigned long slabWindowOffset = 0x200000000;
+
+static const unsigned long slabWindowSize = 0x40000000;
+
+static const unsigned long slotCount = slabWindowSize / SlabCache::slabSize;
+
+/**
+ * @brief Bitmap of slab-sized slots in the window which are currently backed.
+ */
+static unsigned long slotMap[slotCount / 64];
+
+static unsigned long slotHint = 0;
+
+static inline unsigned long slabWindowBase()
+{
+    return (unsigned long)&__high_mem + slabWindowOffset;
+}
+
+static void *reserveSlot()
+{
+    for (unsigned long n = 0; n < slotCount / 64; n++)
+    {
+        unsigned long i = (slotHint + n) % (slotCount / 64);
+        if (~slotMap[i] != 0)
+        {
+            int bit = __builtin_ctzl(~slotMap[i]);
+            slotMap[i] |= 1UL << bit;
+            slotHint = i;
+            return (void *)(slabWindowBase() + (i * 64 + bit) * SlabCache::slabSize);
+        }
+    }
+    return nullptr;
+}
+
+static void freeSlot(void *slot)
+{
+    unsigned long index = ((unsigned long)slot - slabWindowBase()) / SlabCache::slabSize;
+    slotMap[index / 64] &= ~(1UL << (index % 64));
+    slotHint = index / 64;
+}
+
+SlabCache *SlabCache::cacheList = nullptr;
+
+SlabCache::SlabCache(const char *name, unsigned long objectSize)
+    : name(name), partialSlabs(nullptr), fullSlabs(nullptr), emptySlabs(nullptr),
+      slabCount(0), emptyCount(0), activeObjects(0)
+{
+    // Objects must be able to hold a free-list pointer, and are kept 16-byte aligned
+    if (objectSize < sizeof(void *))
+    {
+        objectSize = sizeof(void *);
+    }
+    this->objectSize = (objectSize + 15) & ~15UL;
+    this->objectOffset = (sizeof(Slab) + 15) & ~15UL;
+    this->objectsPerSlab = (slabSize - objectOffset) / this->objectSize;
+    this->nextCache = cacheList;
+    cacheList = this;
+}
+
+void *SlabCache::allocate()
+{
+    Slab *slab = partialSlabs;
+    if (slab == nullptr && emptySlabs != nullptr)
+    {
+        slab = emptySlabs;
+        unlink(emptySlabs, slab);
+        push(partialSlabs, slab);
+        emptyCount--;
+    }
+    else if (slab == nullptr)
+    {
+        slab = grow();
+        if (slab == nullptr)
+        {
+            return nullptr;
+        }
+        push(partialSlabs, slab);
+    }
+
+    void *obj;
+    if (slab->freeList != nullptr)
+    {
+        obj = slab->freeList;
+        slab->freeList = *(void **)obj;
+    }
+    else
+    {
+        obj = (void *)((unsigned long)slab + objectOffset + slab->nextUnused * objectSize);
+        slab->nextUnused++;
+    }
+
+    slab->inUse++;
+    activeObjects++;
+    if (slab->inUse == objectsPerSlab)
+    {
+        unlink(partialSlabs, slab);
+        push(fullSlabs, slab);
+    }
+    return obj;
+}
+
+void SlabCache::free(void *ptr)
+{
+    Slab *slab = (Slab *)((unsigned long)ptr & ~(slabSize - 1));
+    if (slab->inUse == objectsPerSlab)
+    {
+        unlink(fullSlabs, slab);
+        push(partialSlabs, slab);
+    }
+
+    *(void **)ptr = slab->freeList;
+    slab->freeList = ptr;
+    slab->inUse--;
+    activeObjects--;
+
+    if (slab->inUse == 0)
+    {
+        unlink(partialSlabs, slab);
+        if (emptyCount >= maxEmptySlabs)
+        {
+            release(slab);
+        }
+        else
+        {
+            push(emptySlabs, slab);
+            emptyCount++;
+        }
+    }
+}
+
+const char *SlabCache::getName() const
+{
+    return name;
+}
+
+unsigned long SlabCache::getObjectSize() const
+{
+    return objectSize;
+}
+
+unsigned long SlabCache::getObjectsPerSlab() const
+{
+    return objectsPerSlab;
+}
+
+unsigned long SlabCache::getSlabCount() const
+{
+    return slabCount;
+}
+
+unsigned long SlabCache::getActiveObjects() const
+{
+    return activeObjects;
+}
+
+unsigned long SlabCache::getTotalObjects() const
+{
+    return slabCount * objectsPerSlab;
+}
+
+bool SlabCache::contains(const void *ptr)
+{
+    return (unsigned long)ptr >= slabWindowBase() && (unsigned long)ptr < slabWindowBase() + slabWindowSize;
+}
+
+SlabCache *SlabCache::owner(const void *ptr)
+{
+    return ((Slab *)((unsigned long)ptr & ~(slabSize - 1)))->cache;
+}
+
+SlabCache *SlabCache::first()
+{
+    return cacheList;
+}
+
+SlabCache *SlabCache::next() const
+{
+    return nextCache;
+}
+
+void SlabCache::logStatistics()
+{
+    for (SlabCache *c = cacheList; c != nullptr; c = c->nextCache)
+    {
+        if (c->slabCount == 0)
+        {
+            continue;
+        }
+        kernelLog(LogLevel::DEBUG, "slab %s: size %i, %i/%i objects in use, %i slabs",
+                  c->name, c->objectSize, c->activeObjects, c->getTotalObjects(), c->slabCount);
+    }
+}
+
+SlabCache::Slab *SlabCache::grow()
+{
+    void *slot = reserveSlot();
+    if (slot == nullptr)
+    {
+        kernelLog(LogLevel::WARNING, "Slab window exhausted while growing cache %s", name);
+        return nullptr;
+    }
+
+    physaddr_t frame = pageAllocator.reserve(slabSize);
+    if (frame == PageAllocator::NOMEM)
+    {
+        freeSlot(slot);
+        return nullptr;
+    }
+    map_region(slot, slabSize, frame, PAGE_RW);
+
+    Slab *slab = (Slab *)slot;
+    slab->cache = this;
+    slab->prev = nullptr;
+    slab->next = nullptr;
+    slab->freeList = nullptr;
+    slab->nextUnused = 0;
+    slab->inUse = 0;
+    slabCount++;
+    return slab;
+}
+
+void SlabCache::release(Slab *slab)
+{
+    physaddr_t frame = getPageFrame(slab);
+    unmap_region(slab, slabSize);
+    pageAllocator.free(frame);
+    freeSlot(slab);
+    slabCount--;
+}
+
+void SlabCache::push(Slab *&list, Slab *slab)
+{
+    slab->prev = nullptr;
+    slab->next = list;
+    if (list != nullptr)
+    {
+        list->prev = slab;
+    }
+    list = slab;
+}
+
+void SlabCache::unlink(Slab *&list, Slab *slab)
+{
+    if (slab->prev != nullptr)
+    {
+        slab->prev->next = slab->next;
+    }
+    else
+    {
+        list = slab->next;
+    }
+    if (slab->next != nullptr)
+    {
+        slab->next->prev = slab->prev;
+    }
+    slab->prev = nullptr;
+    slab->next = nullptr;
+}
+
+/*
+ * General-purpose size classes backing the global `operator new`. Requests
+ * are rounded up to the next power of two, from 16 bytes up to 2 KiB.
+ */
+static const int minSizeClass = 4;
+
+static const int maxSizeClass = 11;
+
+static SlabCache sizeClasses[] = {
+    {"size-16", 16},
+    {"size-32", 32},
+    {"size-64", 64},
+    {"size-128", 128},
+    {"size-256", 256},
+    {"size-512", 512},
+    {"size-1024", 1024},
+    {"size-2048", 2048}};
+
+void *kernel::memory::slabAllocate(size_t size)
+{
+    int k = llog2(size);
+    if (k > maxSizeClass)
+    {
+        return nullptr;
+    }
+    else if (k < minSizeClass)
+    {
+        k = minSizeClass;
+    }
+    return sizeClasses[k - minSizeClass].allocate();
+}
+
+bool kernel::memory::slabFree(void *ptr)
+{
+    if (!SlabCache::contains(ptr))
+    {
+        return false;
+    }
+    SlabCache::owner(ptr)->free(ptr);
+    return true;
+}
@@ -0,0 +1,203 @@
+#ifndef KERNEL_SLAB_H
+#define KERNEL_SLAB_H
+
+#include <cstddef>
+
+namespace kernel::memory
+{
+
+    /**
+     * @brief Allocates fixed-size objects out of page-backed slabs. Each slab
+     * is a naturally aligned chunk of virtual memory inside a dedicated kernel
+     * window, which lets `free()` find the owning slab (and cache) from an
+     * object pointer in constant time.
+     */
+    class SlabCache
+    {
+    public:
+        /**
+         * @brief Size in bytes of a single slab. Slabs are aligned to this
+         * size in virtual memory.
+         */
+        static const unsigned long slabSize = 1UL << 16;
+
+        /**
+         * @brief Constructs an empty cache. No memory is reserved until the
+         * first call to `allocate()`, so caches may be declared as globals.
+         *
+         * @param name human-readable name used when reporting statistics
+         * @param objectSize size in bytes of each object in this cache
+         */
+        SlabCache(const char *name, unsigned long objectSize);
+
+        /**
+         * @brief Reserves one object from this cache.
+         * @return a pointer to uninitialized storage, or nullptr if no memory
+         * could be obtained for a new slab.
+         */
+        void *allocate();
+
+        /**
+         * @brief Returns an object to this cache. `ptr` must have been
+         * obtained from this cache's `allocate()`.
+         * @param ptr object to free
+         */
+        void free(void *ptr);
+
+        const char *getName() const;
+
+        unsigned long getObjectSize() const;
+
+        unsigned long getObjectsPerSlab() const;
+
+        /**
+         * @return the number of slabs currently backing this cache
+         */
+        unsigned long getSlabCount() const;
+
+        /**
+         * @return the number of objects currently handed out by this cache
+         */
+        unsigned long getActiveObjects() const;
+
+        /**
+         * @return the total number of object slots in this cache's slabs
+         */
+        unsigned long getTotalObjects() const;
+
+        /**
+         * @brief Checks whether `ptr` lies inside the slab window.
+         * @param ptr pointer to check
+         * @return true if `ptr` was allocated by some SlabCache
+         */
+        static bool contains(const void *ptr);
+
+        /**
+         * @brief Finds the cache which owns the object at `ptr`.
+         * @param ptr pointer to an object inside the slab window
+         * @return the owning cache
+         */
+        static SlabCache *owner(const void *ptr);
+
+        /**
+         * @return the first cache in the global list of caches
+         */
+        static SlabCache *first();
+
+        /**
+         * @return the next cache in the global list of caches
+         */
+        SlabCache *next() const;
+
+        /**
+         * @brief Writes occupancy statistics for every cache to the kernel log.
+         */
+        static void logStatistics();
+
+    private:
+        class Slab
+        {
+        public:
+            SlabCache *cache;
+
+            Slab *prev;
+
+            Slab *next;
+
+            /**
+             * @brief Singly-linked list of freed objects inside this slab
+             */
+            void *freeList;
+
+            /**
+             * @brief Index of the first object slot that has never been handed
+             * out. Slots are carved lazily so a new slab costs O(1).
+             */
+            unsigned long nextUnused;
+
+            unsigned long inUse;
+        };
+
+        /**
+         * @brief Number of empty slabs to keep around before returning memory
+         * to the page allocator.
+         */
+        static const unsigned long maxEmptySlabs = 1;
+
+        static SlabCache *cacheList;
+
+        const char *name;
+
+        unsigned long objectSize;
+
+        unsigned long objectsPerSlab;
+
+        unsigned long objectOffset;
+
+        Slab *partialSlabs;
+
+        Slab *fullSlabs;
+
+        Slab *emptySlabs;
+
+        unsigned long slabCount;
+
+        unsigned long emptyCount;
+
+        unsigned long activeObjects;
+
+        SlabCache *nextCache;
+
+        Slab *grow();
+
+        void release(Slab *slab);
+
+        static void push(Slab *&list, Slab *slab);
+
+        static void unlink(Slab *&list, Slab *slab);
+    };
+
+    /**
+     * @brief Typed wrapper around SlabCache for a particular kernel object.
+     * Classes route their `operator new`/`operator delete` through a static
+     * instance of this template to get O(1) allocation.
+     */
+    template <typename T>
+    class kmem_cache : public SlabCache
+    {
+    public:
+        kmem_cache(const char *name)
+            : SlabCache(name, sizeof(T))
+        {
+        }
+
+        T *allocate()
+        {
+            return (T *)SlabCache::allocate();
+        }
+
+        void free(T *obj)
+        {
+            SlabCache::free(obj);
+        }
+    };
+
+    /**
+     * @brief Allocates `size` bytes from the general-purpose size-class caches.
+     * @param size number of bytes to allocate
+     * @return a pointer to the new object, or nullptr if `size` is larger
+     * than the biggest size class or no memory is available.
+     */
+    void *slabAllocate(size_t size);
+
+    /**
+     * @brief Frees `ptr` if it belongs to a slab cache.
+     * @param ptr pointer to free
+     * @return true if `ptr` was freed, false if it does not belong to any
+     * slab cache and must be freed elsewhere.
+     */
+    bool slabFree(void *ptr);
+
+}
+
+#endif
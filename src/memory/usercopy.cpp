@@ -0,0 +1,70 @@
+#include "usercopy.h"
+#include "types/status.h"
+
+/**
+ * @brief Copies like memcpy, returning the number of bytes left uncopied if
+ * a user access faulted. Implementation is platform-dependent.
+ */
+extern "C" unsigned long copy_user(void *dest, const void *src, unsigned long count);
+
+/**
+ * @brief Copies a string of at most `count` bytes, returning its length,
+ * `count` if it was not terminated, or -1 on a fault. Implementation is
+ * platform-dependent.
+ */
+extern "C" long strncpy_user(char *dest, const char *src, unsigned long count);
+
+/**
+ * @brief End of user memory; everything above is the recursive page table
+ * mapping or the kernel
+ */
+static const unsigned long userLimit = 0x7FC0000000;
+
+bool kernel::memory::is_user_range(const void *ptr, size_t size)
+{
+    unsigned long start = (unsigned long)ptr;
+    return start < userLimit && size <= userLimit - start;
+}
+
+int kernel::memory::copy_from_user(void *dest, const void *src, size_t size)
+{
+    if (!is_user_range(src, size) || copy_user(dest, src, size) != 0)
+    {
+        return EINVAL;
+    }
+    return ENONE;
+}
+
+int kernel::memory::copy_to_user(void *dest, const void *src, size_t size)
+{
+    if (!is_user_range(dest, size) || copy_user(dest, src, size) != 0)
+    {
+        return EINVAL;
+    }
+    return ENONE;
+}
+
+long kernel::memory::strncpy_from_user(char *dest, const char *src, size_t size)
+{
+    if ((unsigned long)src >= userLimit || size == 0)
+    {
+        return EINVAL;
+    }
+
+    // Never read past the end of user memory
+    size_t count = size;
+    if (count > userLimit - (unsigned long)src)
+    {
+        count = userLimit - (unsigned long)src;
+    }
+    long length = strncpy_user(dest, src, count);
+    if (length < 0)
+    {
+        return EINVAL;
+    }
+    else if ((unsigned long)length == count)
+    {
+        return count < size ? EINVAL : EFULL;
+    }
+    return length;
+}
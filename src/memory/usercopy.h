@@ -0,0 +1,52 @@
+#ifndef KERNEL_USERCOPY_H
+#define KERNEL_USERCOPY_H
+
+#include <cstddef>
+
+namespace kernel::memory
+{
+
+    /**
+     * @brief Checks that `[ptr, ptr + size)` lies entirely in user memory.
+     * Says nothing about whether the range is mapped.
+     */
+    bool is_user_range(const void *ptr, size_t size);
+
+    /**
+     * @brief Copies `size` bytes from user memory into the kernel. A fault on
+     * the user buffer that cannot be resolved ends the copy instead of
+     * panicking the kernel.
+     *
+     * @param dest kernel buffer to copy into
+     * @param src user address to copy from
+     * @param size number of bytes to copy
+     * @return ENONE, or EINVAL if `src` is not a valid user buffer
+     */
+    int copy_from_user(void *dest, const void *src, size_t size);
+
+    /**
+     * @brief Copies `size` bytes from the kernel into user memory. Faults are
+     * handled as in `copy_from_user`.
+     *
+     * @param dest user address to copy into
+     * @param src kernel buffer to copy from
+     * @param size number of bytes to copy
+     * @return ENONE, or EINVAL if `dest` is not a valid user buffer
+     */
+    int copy_to_user(void *dest, const void *src, size_t size);
+
+    /**
+     * @brief Copies a null-terminated string out of user memory, copying at
+     * most `size` bytes including the terminator.
+     *
+     * @param dest kernel buffer of at least `size` bytes
+     * @param src user string to copy
+     * @param size size of `dest`
+     * @return the length of the string, EFULL if it does not fit in `dest`,
+     * or EINVAL if `src` is not a valid user string
+     */
+    long strncpy_from_user(char *dest, const char *src, size_t size);
+
+}
+
+#endif
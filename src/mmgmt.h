@@ -6,5 +6,6 @@
 #include "memory/new.h"
 #include "memory/mmap.h"
 #include "memory/addressspace.h"
+#include "memory/slab.h"
 
 #endif
\ No newline at end of file
@@ -1,5 +1,8 @@
 #include "sched/context.h"
 #include "util/string.h"
+#include "memory/slab.h"
+
+static kernel::memory::kmem_cache<kernel::sched::Context> contextCache("context");
 
 kernel::sched::Context::Context()
 {
@@ -72,6 +75,19 @@ kernel::sched::Context::Context(void *pc, void *sp, void *ksp)
     kernelStack = (uint64_t)ksp;
 }
 
+void *kernel::sched::Context::operator new(size_t)
+{
+    return contextCache.allocate();
+}
+
+void kernel::sched::Context::operator delete(void *ptr)
+{
+    if (ptr != nullptr)
+    {
+        contextCache.free((Context *)ptr);
+    }
+}
+
 void kernel::sched::Context::functionCall(void *func_ptr, void *returnLoc, unsigned long arg)
 {
     programCounter = (unsigned long)func_ptr;
@@ -121,6 +137,12 @@ void kernel::sched::Context::setReturnValue(unsigned long v)
     gpRegs[0] = v;
 }
 
+void kernel::sched::Context::restartSyscall()
+{
+    // ELR_EL1 points just past the 4-byte svc instruction
+    programCounter -= 4;
+}
+
 void kernel::sched::Context::pushLong(unsigned long v)
 {
     unsigned long *sp = (unsigned long *)stackPointer;
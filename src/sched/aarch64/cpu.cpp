@@ -0,0 +1,9 @@
+#include "sched/cpu.h"
+
+int kernel::sched::currentCpu()
+{
+    // The Cortex-A53 cores of the BCM2837 are numbered by affinity level 0
+    unsigned long mpidr;
+    asm volatile("mrs %0, mpidr_el1" : "=r"(mpidr));
+    return mpidr & (maxCpus - 1);
+}
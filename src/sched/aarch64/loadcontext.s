@@ -1,7 +1,21 @@
 .section ".text"
 
+.global call_on_stack
+call_on_stack:
+    mov sp, x0
+    br x1
+
 .global load_context
 load_context:
+    // Move onto the context's kernel stack before unlocking the kernel:
+    // once other processors are let in, they may resume the process whose
+    // kernel stack this processor was on
+    ldr x1, [x0, #800]
+    mov sp, x1
+    mov x19, x0
+    bl kernel_lock_release
+    mov x0, x19
+
     // Load FP registers from (*x0)
     ld4 {v0.2d, v1.2d, v2.2d, v3.2d}, [x0], #64
     ld4 {v4.2d, v5.2d, v6.2d, v7.2d}, [x0], #64
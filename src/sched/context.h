@@ -2,6 +2,7 @@
 #define KERNEL_CONTEXT_H
 
 #include <cstdint>
+#include <cstddef>
 
 namespace kernel::sched
 {
@@ -17,6 +18,10 @@ namespace kernel::sched
 
         Context(void *pc, void *sp, void *ksp);
 
+        static void *operator new(size_t size);
+
+        static void operator delete(void *ptr);
+
         void functionCall(void *func_ptr, void *returnLoc, unsigned long arg);
 
         void setProgramCounter(void *pc);
@@ -35,6 +40,14 @@ namespace kernel::sched
 
         void setReturnValue(unsigned long v);
 
+        /**
+         * @brief Winds this context back to the instruction that made the
+         * current system call, so it is made again when the context is
+         * resumed. The arguments are left as they were, so the call must not
+         * have set a return value.
+         */
+        void restartSyscall();
+
         void pushLong(unsigned long v);
 
         void pushString(const char *str);
@@ -63,8 +76,19 @@ namespace kernel::sched
 #endif
     };
 
+    /**
+     * @brief Unlocks the kernel and resumes `ctx`. The processor moves onto
+     * the context's kernel stack before unlocking, so `ctx` must not be
+     * stored on that stack.
+     */
     extern "C" void load_context(const Context *ctx);
 
+    /**
+     * @brief Calls `fn` with the stack pointer moved to `stack`, abandoning
+     * the current stack. `fn` must not return.
+     */
+    extern "C" void call_on_stack(void *stack, void (*fn)());
+
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,21 @@
+#ifndef KERNEL_CPU_H
+#define KERNEL_CPU_H
+
+namespace kernel::sched
+{
+
+    /**
+     * @brief Number of processors the kernel runs on. Per-processor state is
+     * kept in arrays of this size, indexed by `currentCpu()`.
+     */
+    const int maxCpus = 4;
+
+    /**
+     * @return the index of the processor running the caller, from 0 to
+     * `maxCpus` - 1
+     */
+    int currentCpu();
+
+}
+
+#endif
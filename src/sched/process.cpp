@@ -3,7 +3,10 @@
 #include "memory/mmap.h"
 #include "types/status.h"
 #include "util/log.h"
-#include "memory/heap.h"
+#include "memory/kernelstack.h"
+#include "memory/slab.h"
+
+static kernel::memory::kmem_cache<kernel::sched::Process> processCache("process");
 
 pid_t kernel::sched::Process::nextPidVal = 1;
 
@@ -15,7 +18,7 @@ pid_t kernel::sched::Process::nextPid()
 }
 
 kernel::sched::Process::Process()
-    : pid(0), parent(0), state(State::ACTIVE), ctx(), addressSpace(nullptr), backupCtx(nullptr), files()
+    : pid(0), parent(0), state(State::ACTIVE), priority(PRIORITY_DEFAULT), timeslice(0), sleepTimer(), resumeState(State::ACTIVE), waitQueue(nullptr), waitPrev(nullptr), waitNext(nullptr), runPrev(nullptr), runNext(nullptr), runQueue(nullptr), pendingSignals(0), ctx(), addressSpace(nullptr), backupCtx(nullptr), files()
 {
     for (int i = 0; i < MAX_SIGNAL; i++)
     {
@@ -24,7 +27,7 @@ kernel::sched::Process::Process()
 }
 
 kernel::sched::Process::Process(pid_t pid, pid_t parent, void *entry, void *stack, void *kernelStack, kernel::memory::AddressSpace *addressSpace)
-    : pid(pid), parent(parent), state(State::ACTIVE), ctx(entry, stack, kernelStack), addressSpace(addressSpace), backupCtx(nullptr), files()
+    : pid(pid), parent(parent), state(State::ACTIVE), priority(PRIORITY_DEFAULT), timeslice(0), sleepTimer(), resumeState(State::ACTIVE), waitQueue(nullptr), waitPrev(nullptr), waitNext(nullptr), runPrev(nullptr), runNext(nullptr), runQueue(nullptr), pendingSignals(0), ctx(entry, stack, kernelStack), addressSpace(addressSpace), backupCtx(nullptr), files()
 {
     addressSpace->addReference();
     for (int i = 0; i < MAX_SIGNAL; i++)
@@ -33,41 +36,12 @@ kernel::sched::Process::Process(pid_t pid, pid_t parent, void *entry, void *stac
     }
 }
 
-kernel::sched::Process::Process(Process &other)
-    : files()
+kernel::sched::Process::~Process()
 {
-    pid = other.pid;
-    parent = other.parent;
-    ctx = other.ctx;
-    state = other.state;
-    addressSpace = other.addressSpace;
-    if (addressSpace != nullptr)
-    {
-        addressSpace->addReference();
-    }
-    if (other.backupCtx == nullptr)
-    {
-        backupCtx = nullptr;
-    }
-    else
+    if (waitQueue != nullptr)
     {
-        backupCtx = new Context(*other.backupCtx);
+        waitQueue->remove(this);
     }
-    for (int i = 0; i < MAX_SIGNAL; i++)
-    {
-        signalHandlers[i].type = other.signalHandlers[i].type;
-        signalHandlers[i].handler = other.signalHandlers[i].handler;
-        signalHandlers[i].trampoline = other.signalHandlers[i].trampoline;
-        signalHandlers[i].userdata = other.signalHandlers[i].userdata;
-    }
-    for (int fd : other.files)
-    {
-        storeFileContext(other.files.get(fd), fd);
-    }
-}
-
-kernel::sched::Process::~Process()
-{
     addressSpace->removeReference();
     if (addressSpace->getRefCount() <= 0)
     {
@@ -82,6 +56,20 @@ kernel::sched::Process::~Process()
     {
         closeFileContext(fd);
     }
+    kernel::memory::kernelStacks.free(ctx.getKernelStack());
+}
+
+void *kernel::sched::Process::operator new(size_t)
+{
+    return processCache.allocate();
+}
+
+void kernel::sched::Process::operator delete(void *ptr)
+{
+    if (ptr != nullptr)
+    {
+        processCache.free((Process *)ptr);
+    }
 }
 
 int kernel::sched::Process::exec(void *pc, void *stack, void *kernelStack, kernel::memory::AddressSpace *addressSpace)
@@ -102,6 +90,10 @@ int kernel::sched::Process::exec(void *pc, void *stack, void *kernelStack, kerne
     }
     this->addressSpace = addressSpace;
     this->addressSpace->addReference();
+    if (ctx.getKernelStack() != kernelStack)
+    {
+        kernel::memory::kernelStacks.free(ctx.getKernelStack());
+    }
     ctx.setProgramCounter(pc);
     ctx.setStackPointer(stack);
     ctx.setKernelStack(kernelStack);
@@ -112,23 +104,66 @@ kernel::sched::Process *kernel::sched::Process::clone(pid_t pid, void *pc, void
 {
     using namespace kernel::fs;
 
-    void *base = rmalloc(1UL << 16);
-    if (base == nullptr)
+    void *kernelStack = kernel::memory::kernelStacks.allocate();
+    if (kernelStack == nullptr)
     {
         return nullptr;
     }
 
-    void *kernelStack = (void *)((unsigned long)base + (1UL << 16));
     Process *copy = new Process(pid, this->pid, pc, stack, kernelStack, this->addressSpace);
     if (copy == nullptr)
     {
+        kernel::memory::kernelStacks.free(kernelStack);
         return nullptr;
     }
+    copy->priority = priority;
     copy->getContext()->functionCall(pc, nullptr, (unsigned long)userdata);
 
     for (int fd : files)
     {
-        copy->storeFileContext(files.get(fd)->copy(), fd);
+        kernel::fs::FileContext *f = files.get(fd)->copy();
+        if (f != nullptr)
+        {
+            f->setFlags(files.get(fd)->getFlags());
+        }
+        copy->storeFileContext(f, fd);
+    }
+
+    return copy;
+}
+
+kernel::sched::Process *kernel::sched::Process::fork(pid_t pid, kernel::memory::AddressSpace *addressSpace)
+{
+    void *kernelStack = kernel::memory::kernelStacks.allocate();
+    if (kernelStack == nullptr)
+    {
+        return nullptr;
+    }
+
+    Process *copy = new Process(pid, this->pid, ctx.getProgramCounter(), ctx.getStackPointer(), kernelStack, addressSpace);
+    if (copy == nullptr)
+    {
+        kernel::memory::kernelStacks.free(kernelStack);
+        return nullptr;
+    }
+    copy->ctx = ctx;
+    copy->priority = priority;
+    copy->ctx.setKernelStack(kernelStack);
+    copy->ctx.setReturnValue(0);
+
+    for (int i = 0; i < MAX_SIGNAL; i++)
+    {
+        copy->signalHandlers[i] = signalHandlers[i];
+    }
+
+    for (int fd : files)
+    {
+        kernel::fs::FileContext *f = files.get(fd)->copy();
+        if (f != nullptr)
+        {
+            f->setFlags(files.get(fd)->getFlags());
+        }
+        copy->storeFileContext(f, fd);
     }
 
     return copy;
@@ -154,6 +189,47 @@ void kernel::sched::Process::setState(State newState)
     state = newState;
 }
 
+int kernel::sched::Process::getPriority() const
+{
+    return priority;
+}
+
+void kernel::sched::Process::setPriority(int priority)
+{
+    this->priority = priority;
+}
+
+unsigned int kernel::sched::Process::getTimeslice() const
+{
+    return timeslice;
+}
+
+void kernel::sched::Process::setTimeslice(unsigned int microseconds)
+{
+    timeslice = microseconds;
+}
+
+kernel::sched::Timer *kernel::sched::Process::getSleepTimer()
+{
+    return &sleepTimer;
+}
+
+void kernel::sched::Process::suspend(State state)
+{
+    resumeState = this->state;
+    this->state = state;
+}
+
+void kernel::sched::Process::resume()
+{
+    state = resumeState;
+}
+
+kernel::sched::WaitQueue *kernel::sched::Process::getWaitQueue() const
+{
+    return waitQueue;
+}
+
 pid_t kernel::sched::Process::getPid() const
 {
     return pid;
@@ -218,6 +294,25 @@ int kernel::sched::Process::signalTrigger(int sig)
     }
 }
 
+void kernel::sched::Process::postSignal(int sig)
+{
+    if (sig >= 0 && sig < MAX_SIGNAL)
+    {
+        pendingSignals |= 1UL << sig;
+    }
+}
+
+int kernel::sched::Process::takePendingSignal()
+{
+    if (pendingSignals == 0)
+    {
+        return -1;
+    }
+    int sig = __builtin_ctzl(pendingSignals);
+    pendingSignals &= ~(1UL << sig);
+    return sig;
+}
+
 void kernel::sched::Process::signalReturn()
 {
     if (state != State::SIGNAL)
@@ -333,48 +428,3 @@ int kernel::sched::Process::closeFileContext(int fd)
     return ENONE;
 }
 
-kernel::sched::Process &kernel::sched::Process::operator=(Process &other)
-{
-    pid = other.pid;
-    parent = other.parent;
-    ctx = other.ctx;
-    state = other.state;
-    if (addressSpace != nullptr && addressSpace != other.addressSpace)
-    {
-        addressSpace->removeReference();
-        if (addressSpace->getRefCount() <= 0)
-        {
-            kernel::memory::destoryAddressSpace(*addressSpace);
-            delete addressSpace;
-        }
-    }
-    addressSpace = other.addressSpace;
-    if (addressSpace != nullptr)
-    {
-        addressSpace->addReference();
-    }
-    if (other.backupCtx == nullptr)
-    {
-        backupCtx = nullptr;
-    }
-    else
-    {
-        backupCtx = new Context(*other.backupCtx);
-    }
-    for (int i = 0; i < MAX_SIGNAL; i++)
-    {
-        signalHandlers[i].type = other.signalHandlers[i].type;
-        signalHandlers[i].handler = other.signalHandlers[i].handler;
-        signalHandlers[i].trampoline = other.signalHandlers[i].trampoline;
-        signalHandlers[i].userdata = other.signalHandlers[i].userdata;
-    }
-    for (int fd : files)
-    {
-        closeFileContext(fd);
-    }
-    for (int fd : other.files)
-    {
-        storeFileContext(other.files.get(fd), fd);
-    }
-    return *this;
-}
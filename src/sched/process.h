@@ -4,9 +4,15 @@
 #include "memory/addressspace.h"
 #include "context.h"
 #include "types/pid.h"
+#include "types/priority.h"
 #include "signalaction.h"
 #include "containers/binary_search_tree.h"
 #include "fs/filecontext.h"
+#include "timerqueue.h"
+#include "waitqueue.h"
+#include <cstddef>
+
+class queue;
 
 namespace kernel::sched
 {
@@ -18,25 +24,48 @@ namespace kernel::sched
         {
             ACTIVE,
             SIGNAL,
-            SIGWAIT
+            SIGWAIT,
+            SLEEPING,
+            BLOCKED
         };
 
         static pid_t nextPid();
 
         Process();
 
+        /**
+         * @param kernelStack top of a stack from `kernelStacks`, which the
+         * new process takes ownership of
+         */
         Process(pid_t pid, pid_t parent, void *entry, void *stack, void *kernelStack, kernel::memory::AddressSpace *addressSpace);
 
-        Process(Process &other);
+        /**
+         * @brief Processes own their kernel stack, so they are never copied
+         */
+        Process(Process &other) = delete;
 
         ~Process();
 
-        Process &operator=(Process &other);
+        static void *operator new(size_t size);
+
+        static void operator delete(void *ptr);
 
+        Process &operator=(Process &other) = delete;
+
+        /**
+         * @brief Replaces this process's program. A `kernelStack` other than
+         * the current one replaces it, and the old one is freed.
+         */
         int exec(void *pc, void *stack, void *kernelStack, kernel::memory::AddressSpace *addressSpace);
 
         Process *clone(pid_t pid, void *pc, void *stack, void *userdata);
 
+        /**
+         * @brief Creates a copy of this process running in `addressSpace`. The
+         * copy resumes from the current context with a return value of 0.
+         */
+        Process *fork(pid_t pid, kernel::memory::AddressSpace *addressSpace);
+
         Context *getContext();
 
         void storeContext(Context *newCtx);
@@ -49,12 +78,63 @@ namespace kernel::sched
 
         pid_t getParent() const;
 
+        int getPriority() const;
+
+        /**
+         * @brief Changes this process's priority. The scheduler only sees the
+         * new priority the next time the process is queued.
+         */
+        void setPriority(int priority);
+
+        /**
+         * @return the number of microseconds left before this process must
+         * give way to others of the same priority
+         */
+        unsigned int getTimeslice() const;
+
+        void setTimeslice(unsigned int microseconds);
+
+        /**
+         * @return the timer that wakes this process while it is SLEEPING
+         */
+        Timer *getSleepTimer();
+
+        /**
+         * @brief Stops this process from being scheduled by moving it to
+         * `state`, remembering the state to return to in `resume()`.
+         */
+        void suspend(State state);
+
+        /**
+         * @brief Returns this process to the state it was in before
+         * `suspend()`.
+         */
+        void resume();
+
+        /**
+         * @return the queue this process is BLOCKED on, or nullptr
+         */
+        WaitQueue *getWaitQueue() const;
+
         kernel::memory::AddressSpace *getAddressSpace();
 
         void setSignalAction(int signal, void (*handler)(void *), void (*trampoline)(void), void *userdata);
 
         int signalTrigger(int sig);
 
+        /**
+         * @brief Records `sig` to be raised on this process later, by the
+         * processor that is running it
+         */
+        void postSignal(int sig);
+
+        /**
+         * @brief Removes the lowest-numbered signal posted with
+         * `postSignal()`.
+         * @return the signal, or -1 if none is pending
+         */
+        int takePendingSignal();
+
         void signalReturn();
 
         void storeProgramArgs(char *const argv[], char *const envp[]);
@@ -68,6 +148,10 @@ namespace kernel::sched
         int closeFileContext(int fd);
 
     private:
+        friend class ::queue;
+
+        friend class WaitQueue;
+
         static pid_t nextPidVal;
 
         static const int MAX_SIGNAL = 64;
@@ -78,6 +162,43 @@ namespace kernel::sched
 
         State state;
 
+        int priority;
+
+        unsigned int timeslice;
+
+        Timer sleepTimer;
+
+        /**
+         * @brief State to return to once woken from SLEEPING or BLOCKED, so
+         * a process that waits inside a signal handler can still return
+         * from it
+         */
+        State resumeState;
+
+        /**
+         * @brief The queue this process is waiting on and its neighbours
+         * there, managed by `WaitQueue`
+         */
+        WaitQueue *waitQueue;
+
+        Process *waitPrev, *waitNext;
+
+        /**
+         * @brief Links to the neighbouring processes in the run queue this
+         * process is waiting in, managed by `queue`
+         */
+        Process *runPrev, *runNext;
+
+        /**
+         * @brief The run queue this process is waiting in, or nullptr
+         */
+        ::queue *runQueue;
+
+        /**
+         * @brief Bit n is set while signal n is posted but not yet raised
+         */
+        unsigned long pendingSignals;
+
         kernel::memory::AddressSpace *addressSpace;
 
         SignalAction signalHandlers[MAX_SIGNAL];
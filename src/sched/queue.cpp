@@ -1,72 +1,92 @@
 #include "queue.h"
 #include "process.h"
 
-node::node(kernel::sched::Process *value) : value(value), prev(nullptr), next(nullptr){};
+static_assert(queue::priority_levels <= 32, "ready_mask has one bit per priority");
 
 queue::queue()
 {
     queue_size = 0;
-    linked_list_front = linked_list_back = nullptr;
+    for (int i = 0; i < priority_levels; i++)
+    {
+        fronts[i] = backs[i] = nullptr;
+    }
+    ready_mask = 0;
     cur_Process = nullptr;
 };
 
 void queue::enqueue(kernel::sched::Process *process)
 {
-    node *new_node = new node(process);
-    if (empty())
+    if (process->runQueue != nullptr)
+    {
+        return;
+    }
+    int priority = process->getPriority();
+    process->runNext = nullptr;
+    process->runPrev = backs[priority];
+    if (fronts[priority] == nullptr)
     {
-        linked_list_front = new_node;
+        fronts[priority] = process;
+        ready_mask |= 1U << priority;
     }
     else
     {
-        node *last_node = linked_list_back;
-        last_node->next = new_node;
-        new_node->prev = last_node;
+        backs[priority]->runNext = process;
     }
-    linked_list_back = new_node;
+    backs[priority] = process;
+    process->runQueue = this;
     queue_size++;
 }
 
 kernel::sched::Process *queue::dequeue()
 {
-    if (queue_size == 0)
+    int priority = highest_ready();
+    if (priority < 0)
     {
         return nullptr;
     }
-    node *return_node = linked_list_front;
-    linked_list_front = linked_list_front->next;
-    if (linked_list_back == return_node)
-    {
-        linked_list_back = nullptr;
-    }
-    kernel::sched::Process *p = return_node->value;
-    delete return_node;
-    queue_size--;
+    kernel::sched::Process *p = fronts[priority];
+    remove(p);
     return p;
 }
 
-kernel::sched::Process *queue::remove(pid_t pid)
+bool queue::remove(kernel::sched::Process *process)
 {
-    node *cur_node = linked_list_front;
-    kernel::sched::Process *p;
-
-    while (cur_node->next)
+    if (process->runQueue != this)
     {
-        if (cur_node->value->getPid() == pid)
-        {
-            cur_node->prev->next = cur_node->next;
-            cur_node->next->prev = cur_node->prev;
-            p = cur_node->value;
-            delete cur_node;
-            return p;
-        }
-        cur_node = cur_node->next;
+        return false;
+    }
+    // A process's priority only changes while it is out of the queue
+    int priority = process->getPriority();
+    if (process->runPrev != nullptr)
+    {
+        process->runPrev->runNext = process->runNext;
+    }
+    else
+    {
+        fronts[priority] = process->runNext;
+    }
+    if (process->runNext != nullptr)
+    {
+        process->runNext->runPrev = process->runPrev;
+    }
+    else
+    {
+        backs[priority] = process->runPrev;
+    }
+    if (fronts[priority] == nullptr)
+    {
+        ready_mask &= ~(1U << priority);
     }
+    process->runPrev = process->runNext = nullptr;
+    process->runQueue = nullptr;
+    queue_size--;
+    return true;
 }
 
 kernel::sched::Process *queue::peek()
 {
-    return linked_list_front->value;
+    int priority = highest_ready();
+    return priority < 0 ? nullptr : fronts[priority];
 }
 
 kernel::sched::Process *queue::sched_next()
@@ -78,11 +98,39 @@ kernel::sched::Process *queue::sched_next()
     if (!empty())
     {
         cur_Process = dequeue();
+        if (cur_Process->getTimeslice() == 0)
+        {
+            cur_Process->setTimeslice(timeslice_us);
+        }
         return cur_Process;
     }
     return nullptr;
 }
 
+void queue::charge(unsigned long elapsed)
+{
+    if (cur_Process == nullptr)
+    {
+        return;
+    }
+    unsigned int left = cur_Process->getTimeslice();
+    cur_Process->setTimeslice(elapsed >= left ? 0 : left - elapsed);
+}
+
+bool queue::preempt_pending() const
+{
+    if (cur_Process == nullptr)
+    {
+        return !empty();
+    }
+    return higher_ready() || (cur_Process->getTimeslice() == 0 && !empty());
+}
+
+bool queue::higher_ready() const
+{
+    return cur_Process != nullptr && highest_ready() > cur_Process->getPriority();
+}
+
 int queue::size() const
 {
     return queue_size;
@@ -101,4 +149,9 @@ kernel::sched::Process *queue::get_cur_process()
 void queue::set_cur_process(kernel::sched::Process *proc)
 {
     cur_Process = proc;
-}
\ No newline at end of file
+}
+
+int queue::highest_ready() const
+{
+    return ready_mask == 0 ? -1 : 31 - __builtin_clz(ready_mask);
+}
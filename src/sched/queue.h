@@ -1,37 +1,88 @@
 #ifndef QUEUE_H
 #define QUEUE_H
 
-#include "containers/linked_list.h"
 #include "process.h"
+#include "types/priority.h"
+#include <cstddef>
 
-class node
-{
-public:
-    node(kernel::sched::Process *value);
-    kernel::sched::Process *value;
-    node *prev;
-    node *next;
-};
-
+/**
+ * @brief Run queue with one FIFO per priority level. A bitmap of the levels
+ * that have ready processes finds the highest one in constant time. The
+ * FIFOs are linked through the processes themselves, so no operation
+ * allocates memory.
+ */
 class queue
 {
 public:
+    static const int priority_levels = PRIORITY_MAX + 1;
+
+    /**
+     * @brief Microseconds a process may run before others of the same
+     * priority get a turn
+     */
+    static const unsigned int timeslice_us = 50000;
+
     queue();
+
+    /**
+     * @brief Adds `process` to the back of the queue for its priority,
+     * unless it is already waiting in this or another run queue.
+     */
     void enqueue(kernel::sched::Process *process);
     kernel::sched::Process *dequeue();
-    kernel::sched::Process *remove(pid_t pid);
+
+    /**
+     * @brief Takes `process` out of this run queue, if it is in it.
+     * @return true if `process` was queued here
+     */
+    bool remove(kernel::sched::Process *process);
     kernel::sched::Process *peek();
+
+    /**
+     * @brief Puts the running process back in its queue, then picks the
+     * first process of the highest ready priority. A process that used up
+     * its timeslice goes to the back of its queue with a new one.
+     */
     kernel::sched::Process *sched_next();
     kernel::sched::Process *get_cur_process();
     void set_cur_process(kernel::sched::Process *proc);
+
+    /**
+     * @brief Charges `elapsed` microseconds of running time to the running
+     * process.
+     */
+    void charge(unsigned long elapsed);
+
+    /**
+     * @return true if the running process should give way, because its
+     * timeslice is used up or a process of higher priority is ready
+     */
+    bool preempt_pending() const;
+
+    /**
+     * @return true if a process of higher priority than the running one is
+     * ready
+     */
+    bool higher_ready() const;
+
     bool empty() const;
     int size() const;
 
 private:
     int queue_size;
-    node *linked_list_front;
-    node *linked_list_back;
+    kernel::sched::Process *fronts[priority_levels];
+    kernel::sched::Process *backs[priority_levels];
+
+    /**
+     * @brief Bit n is set while the queue for priority n is not empty
+     */
+    unsigned int ready_mask;
     kernel::sched::Process *cur_Process;
+
+    /**
+     * @return the highest priority with a ready process, or -1 if none
+     */
+    int highest_ready() const;
 };
 
-#endif
\ No newline at end of file
+#endif
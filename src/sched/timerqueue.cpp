@@ -0,0 +1,154 @@
+#include "timerqueue.h"
+#include "memory/new.h"
+#include "types/status.h"
+
+kernel::sched::Timer::Timer()
+    : deadline(0), expiry(0), callback(nullptr), data(nullptr), index(-1)
+{
+}
+
+kernel::sched::Timer::Timer(void (*callback)(void *), void *data)
+    : deadline(0), expiry(0), callback(callback), data(data), index(-1)
+{
+}
+
+bool kernel::sched::Timer::isArmed() const
+{
+    return index >= 0;
+}
+
+kernel::sched::TimerQueue::TimerQueue()
+    : heap(nullptr), count(0), capacity(0)
+{
+}
+
+kernel::sched::TimerQueue::~TimerQueue()
+{
+    delete[] heap;
+}
+
+int kernel::sched::TimerQueue::add(Timer *timer, unsigned long deadline, unsigned long slack)
+{
+    cancel(timer);
+    if (count == capacity)
+    {
+        unsigned long newCapacity = capacity == 0 ? initialCapacity : capacity * 2;
+        Timer **newHeap = new Timer *[newCapacity];
+        if (newHeap == nullptr)
+        {
+            return ENOMEM;
+        }
+        for (unsigned long i = 0; i < count; i++)
+        {
+            newHeap[i] = heap[i];
+        }
+        delete[] heap;
+        heap = newHeap;
+        capacity = newCapacity;
+    }
+
+    timer->deadline = deadline;
+    // Saturate rather than wrap, so a huge slack cannot make a timer due early
+    timer->expiry = deadline + slack < deadline ? ~0UL : deadline + slack;
+    place(timer, count);
+    count++;
+    siftUp(timer->index);
+    return ENONE;
+}
+
+void kernel::sched::TimerQueue::cancel(Timer *timer)
+{
+    if (timer->isArmed())
+    {
+        removeAt(timer->index);
+    }
+}
+
+unsigned long kernel::sched::TimerQueue::nextExpiry() const
+{
+    return count == 0 ? ~0UL : heap[0]->expiry;
+}
+
+kernel::sched::Timer *kernel::sched::TimerQueue::popDue(unsigned long now)
+{
+    if (count == 0 || heap[0]->deadline > now)
+    {
+        return nullptr;
+    }
+    Timer *timer = heap[0];
+    removeAt(0);
+    return timer;
+}
+
+bool kernel::sched::TimerQueue::empty() const
+{
+    return count == 0;
+}
+
+void kernel::sched::TimerQueue::place(Timer *timer, unsigned long index)
+{
+    heap[index] = timer;
+    timer->index = index;
+}
+
+void kernel::sched::TimerQueue::siftUp(unsigned long index)
+{
+    Timer *timer = heap[index];
+    while (index > 0)
+    {
+        unsigned long parent = (index - 1) / 2;
+        if (heap[parent]->expiry <= timer->expiry)
+        {
+            break;
+        }
+        place(heap[parent], index);
+        index = parent;
+    }
+    place(timer, index);
+}
+
+void kernel::sched::TimerQueue::siftDown(unsigned long index)
+{
+    Timer *timer = heap[index];
+    while (true)
+    {
+        unsigned long child = 2 * index + 1;
+        if (child >= count)
+        {
+            break;
+        }
+        if (child + 1 < count && heap[child + 1]->expiry < heap[child]->expiry)
+        {
+            child++;
+        }
+        if (timer->expiry <= heap[child]->expiry)
+        {
+            break;
+        }
+        place(heap[child], index);
+        index = child;
+    }
+    place(timer, index);
+}
+
+void kernel::sched::TimerQueue::removeAt(unsigned long index)
+{
+    heap[index]->index = -1;
+    count--;
+    if (index == count)
+    {
+        return;
+    }
+    // The last timer fills the hole, then moves whichever way restores
+    // the heap
+    Timer *last = heap[count];
+    place(last, index);
+    if (index > 0 && last->expiry < heap[(index - 1) / 2]->expiry)
+    {
+        siftUp(index);
+    }
+    else
+    {
+        siftDown(index);
+    }
+}
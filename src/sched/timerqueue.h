@@ -0,0 +1,113 @@
+#ifndef KERNEL_TIMERQUEUE_H
+#define KERNEL_TIMERQUEUE_H
+
+namespace kernel::sched
+{
+
+    /**
+     * @brief A callback to run once at a point in time. Times are in
+     * microseconds on the system clock.
+     *
+     * A timer may fire anywhere between its deadline and its expiry (the
+     * deadline plus its slack). Timers whose windows overlap are run
+     * together, so one interrupt serves all of them.
+     */
+    class Timer
+    {
+    public:
+        Timer();
+
+        Timer(void (*callback)(void *), void *data);
+
+        /**
+         * @return true while this timer is waiting in a TimerQueue
+         */
+        bool isArmed() const;
+
+        /**
+         * @brief Earliest time the timer may fire
+         */
+        unsigned long deadline;
+
+        /**
+         * @brief Latest time the timer may fire
+         */
+        unsigned long expiry;
+
+        /**
+         * @brief Called with `data` when the timer fires. The timer is no
+         * longer armed by then, so the callback may re-arm it.
+         */
+        void (*callback)(void *data);
+
+        void *data;
+
+    private:
+        friend class TimerQueue;
+
+        /**
+         * @brief Position in the queue's heap, or -1 if not armed
+         */
+        long index;
+    };
+
+    /**
+     * @brief Pending timers, kept in a binary min-heap ordered by expiry so
+     * the next hardware deadline is always at the top. Arming and
+     * cancelling a timer take O(log n) time.
+     */
+    class TimerQueue
+    {
+    public:
+        TimerQueue();
+
+        ~TimerQueue();
+
+        /**
+         * @brief Arms `timer` to fire between `deadline` and `deadline` +
+         * `slack`. A timer that is already armed is moved.
+         * @return ENONE, or ENOMEM if the heap could not grow
+         */
+        int add(Timer *timer, unsigned long deadline, unsigned long slack);
+
+        /**
+         * @brief Disarms `timer`. Does nothing if it is not armed.
+         */
+        void cancel(Timer *timer);
+
+        /**
+         * @return the earliest expiry of any armed timer, or ~0 if there is
+         * none
+         */
+        unsigned long nextExpiry() const;
+
+        /**
+         * @brief Disarms and returns the timer with the earliest expiry, if
+         * its deadline is at or before `now`. Calling this until it returns
+         * nullptr runs every timer that is due along with the one that made
+         * the clock fire.
+         * @return the timer, or nullptr if none is due
+         */
+        Timer *popDue(unsigned long now);
+
+        bool empty() const;
+
+    private:
+        static const unsigned long initialCapacity = 16;
+
+        Timer **heap;
+
+        unsigned long count, capacity;
+
+        void place(Timer *timer, unsigned long index);
+
+        void siftUp(unsigned long index);
+
+        void siftDown(unsigned long index);
+
+        void removeAt(unsigned long index);
+    };
+
+}
+
+#endif
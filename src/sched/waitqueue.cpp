@@ -0,0 +1,79 @@
+#include "waitqueue.h"
+#include "process.h"
+#include "kernel.h"
+
+kernel::sched::WaitQueue::WaitQueue()
+    : front(nullptr), back(nullptr)
+{
+}
+
+kernel::sched::WaitQueue::~WaitQueue()
+{
+    wakeAll();
+}
+
+void kernel::sched::WaitQueue::add(Process *process)
+{
+    process->waitQueue = this;
+    process->waitNext = nullptr;
+    process->waitPrev = back;
+    if (back == nullptr)
+    {
+        front = process;
+    }
+    else
+    {
+        back->waitNext = process;
+    }
+    back = process;
+}
+
+bool kernel::sched::WaitQueue::remove(Process *process)
+{
+    if (process->waitQueue != this)
+    {
+        return false;
+    }
+    if (process->waitPrev == nullptr)
+    {
+        front = process->waitNext;
+    }
+    else
+    {
+        process->waitPrev->waitNext = process->waitNext;
+    }
+    if (process->waitNext == nullptr)
+    {
+        back = process->waitPrev;
+    }
+    else
+    {
+        process->waitNext->waitPrev = process->waitPrev;
+    }
+    process->waitPrev = process->waitNext = nullptr;
+    process->waitQueue = nullptr;
+    return true;
+}
+
+void kernel::sched::WaitQueue::wakeOne()
+{
+    Process *process = front;
+    if (process != nullptr)
+    {
+        remove(process);
+        kernel::kernel.wake(process);
+    }
+}
+
+void kernel::sched::WaitQueue::wakeAll()
+{
+    while (front != nullptr)
+    {
+        wakeOne();
+    }
+}
+
+bool kernel::sched::WaitQueue::empty() const
+{
+    return front == nullptr;
+}
@@ -0,0 +1,55 @@
+#ifndef KERNEL_WAITQUEUE_H
+#define KERNEL_WAITQUEUE_H
+
+namespace kernel::sched
+{
+
+    class Process;
+
+    /**
+     * @brief Processes blocked until some object changes state, such as a
+     * pipe gaining data. Waiters are linked through the processes
+     * themselves, and are woken in the order they arrived.
+     */
+    class WaitQueue
+    {
+    public:
+        WaitQueue();
+
+        /**
+         * @brief Wakes every waiter, so none is left blocked on an object
+         * that no longer exists.
+         */
+        ~WaitQueue();
+
+        /**
+         * @brief Appends `process`, which must not be waiting on any queue.
+         */
+        void add(Process *process);
+
+        /**
+         * @brief Takes `process` off this queue without waking it.
+         * @return true if `process` was waiting here
+         */
+        bool remove(Process *process);
+
+        /**
+         * @brief Wakes the process that has waited longest, if any.
+         */
+        void wakeOne();
+
+        /**
+         * @brief Wakes every waiting process. Each one repeats the call it
+         * blocked in, and blocks again if it still cannot make progress.
+         */
+        void wakeAll();
+
+        bool empty() const;
+
+    private:
+        Process *front, *back;
+    };
+
+}
+
+#endif
@@ -0,0 +1,88 @@
+#include "../membench.h"
+#include "../string.h"
+#include "../log.h"
+#include <stdint.h>
+
+/**
+ * @brief Number of times each operation is repeated per measurement
+ */
+static const unsigned long iterations = 64;
+
+static const unsigned long sizes[] = {16, 64, 256, 1024, 4096, 65536};
+
+static const unsigned long maxSize = 65536;
+
+static void enableCycleCounter()
+{
+    uint64_t pmcr;
+    asm volatile("mrs %0, pmcr_el0" : "=r"(pmcr));
+    pmcr |= 1; // E, enable counters
+    asm volatile("msr pmcr_el0, %0" ::"r"(pmcr));
+    asm volatile("msr pmcntenset_el0, %0" ::"r"(1UL << 31));
+    asm volatile("isb");
+}
+
+static uint64_t readCycles()
+{
+    uint64_t cycles;
+    asm volatile("isb");
+    asm volatile("mrs %0, pmccntr_el0" : "=r"(cycles));
+    return cycles;
+}
+
+static void report(const char *name, unsigned long size, uint64_t cycles)
+{
+    // Bytes per cycle in hundredths, as the log has no floating-point format
+    unsigned long rate = cycles == 0 ? 0 : (size * iterations * 100) / cycles;
+    kernelLog(LogLevel::INFO, "membench: %s %u bytes: %u.%02u bytes/cycle", name, size, rate / 100, rate % 100);
+}
+
+void membench()
+{
+    // Spare bytes at the end leave room for misaligned and overlapping copies
+    char *src = new char[maxSize + 16];
+    char *dest = new char[maxSize + 16];
+    if (src == nullptr || dest == nullptr)
+    {
+        kernelLog(LogLevel::WARNING, "membench: not enough memory");
+        delete[] src;
+        delete[] dest;
+        return;
+    }
+
+    enableCycleCounter();
+    for (unsigned long i = 0; i < sizeof(sizes) / sizeof(*sizes); i++)
+    {
+        unsigned long size = sizes[i];
+        uint64_t start = readCycles();
+        for (unsigned long j = 0; j < iterations; j++)
+        {
+            memcpy(dest, src, size);
+        }
+        report("memcpy", size, readCycles() - start);
+
+        start = readCycles();
+        for (unsigned long j = 0; j < iterations; j++)
+        {
+            memcpy(dest + 1, src + 3, size);
+        }
+        report("memcpy (misaligned)", size, readCycles() - start);
+
+        start = readCycles();
+        for (unsigned long j = 0; j < iterations; j++)
+        {
+            memmove(src + 8, src, size);
+        }
+        report("memmove (overlapping)", size, readCycles() - start);
+
+        start = readCycles();
+        for (unsigned long j = 0; j < iterations; j++)
+        {
+            memset(dest, j, size);
+        }
+        report("memset", size, readCycles() - start);
+    }
+
+    delete[] src;
+    delete[] dest;
+}
@@ -0,0 +1,235 @@
+.section .text
+
+// Copies of at least this many bytes move 64 bytes per iteration through the
+// SIMD registers instead of the general-purpose ones.
+.equ NEON_THRESHOLD, 512
+
+// Masks IRQs around use of the SIMD registers, exactly like fpu_begin and
+// fpu_end. Only IRQs taken in EL1 skip saving them.
+.macro fp_begin state
+    mrs \state, daif
+    msr daifset, #2
+.endm
+
+.macro fp_end state
+    msr daif, \state
+.endm
+
+# unsigned long fpu_begin();
+.global fpu_begin
+fpu_begin:
+    fp_begin x0
+    ret
+
+# void fpu_end(unsigned long state);
+.global fpu_end
+fpu_end:
+    fp_end x0
+    ret
+
+# void *memcpy(void *dest, const void *src, size_t count);
+.global memcpy
+memcpy:
+    mov x3, x0
+    cmp x2, #16
+    b.lo _memcpy_small
+
+    // Copy the first 16 bytes unaligned, then step forward to the next
+    // 16-byte boundary of the destination. The bytes in between are copied
+    // twice.
+    ldp x4, x5, [x1]
+    stp x4, x5, [x3]
+    neg x6, x3
+    and x6, x6, #15
+    add x1, x1, x6
+    add x3, x3, x6
+    sub x2, x2, x6
+
+    cmp x2, #NEON_THRESHOLD
+    b.lo _memcpy_64
+    fp_begin x9
+_memcpy_neon:
+    ldp q0, q1, [x1]
+    ldp q2, q3, [x1, #32]
+    add x1, x1, #64
+    sub x2, x2, #64
+    stp q0, q1, [x3]
+    stp q2, q3, [x3, #32]
+    add x3, x3, #64
+    cmp x2, #64
+    b.hs _memcpy_neon
+    fp_end x9
+
+_memcpy_64:
+    cmp x2, #64
+    b.lo _memcpy_16
+    ldp x4, x5, [x1]
+    ldp x6, x7, [x1, #16]
+    ldp x8, x9, [x1, #32]
+    ldp x10, x11, [x1, #48]
+    add x1, x1, #64
+    sub x2, x2, #64
+    stp x4, x5, [x3]
+    stp x6, x7, [x3, #16]
+    stp x8, x9, [x3, #32]
+    stp x10, x11, [x3, #48]
+    add x3, x3, #64
+    b _memcpy_64
+
+_memcpy_16:
+    cmp x2, #16
+    b.lo _memcpy_last
+    ldp x4, x5, [x1], #16
+    stp x4, x5, [x3], #16
+    sub x2, x2, #16
+    b _memcpy_16
+
+_memcpy_last:
+    // At least 16 bytes were copied, so finish with the 16 bytes ending at
+    // the end of the buffer, overlapping what was already written
+    cbz x2, _memcpy_done
+    add x1, x1, x2
+    add x3, x3, x2
+    ldp x4, x5, [x1, #-16]
+    stp x4, x5, [x3, #-16]
+_memcpy_done:
+    ret
+
+_memcpy_small:
+    tbz x2, #3, 1f
+    ldr x4, [x1], #8
+    str x4, [x3], #8
+1:  tbz x2, #2, 2f
+    ldr w4, [x1], #4
+    str w4, [x3], #4
+2:  tbz x2, #1, 3f
+    ldrh w4, [x1], #2
+    strh w4, [x3], #2
+3:  tbz x2, #0, 4f
+    ldrb w4, [x1]
+    strb w4, [x3]
+4:  ret
+
+# void *memmove(void *dest, const void *src, size_t count);
+.global memmove
+memmove:
+    // Regions that do not overlap can take the faster copy
+    sub x4, x0, x1
+    cmp x4, x2
+    b.lo _memmove_backward
+    sub x4, x1, x0
+    cmp x4, x2
+    b.hs memcpy
+
+    // Each chunk is loaded completely before any of it is stored, so
+    // stores only ever clobber source bytes that have already been read.
+    mov x3, x0
+_memmove_forward_32:
+    cmp x2, #32
+    b.lo _memmove_forward_1
+    ldp x4, x5, [x1]
+    ldp x6, x7, [x1, #16]
+    add x1, x1, #32
+    sub x2, x2, #32
+    stp x4, x5, [x3]
+    stp x6, x7, [x3, #16]
+    add x3, x3, #32
+    b _memmove_forward_32
+_memmove_forward_1:
+    cbz x2, _memmove_done
+    ldrb w4, [x1], #1
+    strb w4, [x3], #1
+    sub x2, x2, #1
+    b _memmove_forward_1
+
+_memmove_backward:
+    // Destination starts inside the source, so copy from the end
+    add x1, x1, x2
+    add x3, x0, x2
+_memmove_backward_32:
+    cmp x2, #32
+    b.lo _memmove_backward_1
+    ldp x4, x5, [x1, #-16]
+    ldp x6, x7, [x1, #-32]
+    sub x1, x1, #32
+    sub x2, x2, #32
+    stp x4, x5, [x3, #-16]
+    stp x6, x7, [x3, #-32]
+    sub x3, x3, #32
+    b _memmove_backward_32
+_memmove_backward_1:
+    cbz x2, _memmove_done
+    ldrb w4, [x1, #-1]!
+    strb w4, [x3, #-1]!
+    sub x2, x2, #1
+    b _memmove_backward_1
+
+_memmove_done:
+    ret
+
+# void *memset(void *s, int c, size_t count);
+.global memset
+memset:
+    mov x3, x0
+    and x1, x1, #0xFF
+    mov x4, #0x0101010101010101
+    mul x1, x1, x4
+    cmp x2, #16
+    b.lo _memset_small
+
+    // Same approach as memcpy: write the first 16 bytes unaligned, then
+    // continue from the next 16-byte boundary
+    stp x1, x1, [x3]
+    neg x6, x3
+    and x6, x6, #15
+    add x3, x3, x6
+    sub x2, x2, x6
+
+    cmp x2, #NEON_THRESHOLD
+    b.lo _memset_64
+    fp_begin x9
+    dup v0.2d, x1
+_memset_neon:
+    stp q0, q0, [x3]
+    stp q0, q0, [x3, #32]
+    add x3, x3, #64
+    sub x2, x2, #64
+    cmp x2, #64
+    b.hs _memset_neon
+    fp_end x9
+
+_memset_64:
+    cmp x2, #64
+    b.lo _memset_16
+    stp x1, x1, [x3]
+    stp x1, x1, [x3, #16]
+    stp x1, x1, [x3, #32]
+    stp x1, x1, [x3, #48]
+    add x3, x3, #64
+    sub x2, x2, #64
+    b _memset_64
+
+_memset_16:
+    cmp x2, #16
+    b.lo _memset_last
+    stp x1, x1, [x3], #16
+    sub x2, x2, #16
+    b _memset_16
+
+_memset_last:
+    cbz x2, _memset_done
+    add x3, x3, x2
+    stp x1, x1, [x3, #-16]
+_memset_done:
+    ret
+
+_memset_small:
+    tbz x2, #3, 1f
+    str x1, [x3], #8
+1:  tbz x2, #2, 2f
+    str w1, [x3], #4
+2:  tbz x2, #1, 3f
+    strh w1, [x3], #2
+3:  tbz x2, #0, 4f
+    strb w1, [x3]
+4:  ret
@@ -0,0 +1,62 @@
+#include "bakerylock.h"
+
+using kernel::sched::maxCpus;
+
+static inline void memoryBarrier()
+{
+    asm volatile("dmb ish" ::: "memory");
+}
+
+BakeryLock::BakeryLock()
+{
+    for (int i = 0; i < maxCpus; i++)
+    {
+        choosing[i] = false;
+        tickets[i] = 0;
+    }
+}
+
+void BakeryLock::acquire()
+{
+    int self = kernel::sched::currentCpu();
+    choosing[self] = true;
+    memoryBarrier();
+    unsigned long ticket = 0;
+    for (int i = 0; i < maxCpus; i++)
+    {
+        unsigned long other = tickets[i];
+        ticket = other > ticket ? other : ticket;
+    }
+    tickets[self] = ticket + 1;
+    memoryBarrier();
+    choosing[self] = false;
+    memoryBarrier();
+
+    for (int i = 0; i < maxCpus; i++)
+    {
+        if (i == self)
+        {
+            continue;
+        }
+        while (choosing[i])
+        {
+        }
+        memoryBarrier();
+        // Equal tickets are broken by processor number
+        while (true)
+        {
+            unsigned long other = tickets[i];
+            if (other == 0 || other > ticket + 1 || (other == ticket + 1 && i > self))
+            {
+                break;
+            }
+        }
+    }
+    memoryBarrier();
+}
+
+void BakeryLock::release()
+{
+    memoryBarrier();
+    tickets[kernel::sched::currentCpu()] = 0;
+}
@@ -0,0 +1,40 @@
+#ifndef KERNEL_BAKERYLOCK_H
+#define KERNEL_BAKERYLOCK_H
+
+#include "sched/cpu.h"
+
+/**
+ * @brief Mutual exclusion between processors using Lamport's bakery
+ * algorithm. It needs nothing but ordinary loads and stores, so it works on
+ * memory the data cache does not cover, where exclusive loads and stores
+ * are not guaranteed to succeed. Processors acquire the lock in the order
+ * they asked for it.
+ *
+ * The lock is not recursive, and does not mask interrupts.
+ */
+class BakeryLock
+{
+public:
+    BakeryLock();
+
+    /**
+     * @brief Spins until the calling processor holds the lock.
+     */
+    void acquire();
+
+    /**
+     * @brief Releases the lock held by the calling processor.
+     */
+    void release();
+
+private:
+    volatile bool choosing[kernel::sched::maxCpus];
+
+    /**
+     * @brief Ticket of each processor, or 0 if it is not waiting for or
+     * holding the lock
+     */
+    volatile unsigned long tickets[kernel::sched::maxCpus];
+};
+
+#endif
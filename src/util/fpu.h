@@ -0,0 +1,23 @@
+#ifndef _FPU_H
+#define _FPU_H
+
+/**
+ * @brief Starts a section of kernel code that uses the floating-point/SIMD
+ * registers. User register state is saved on every exception from EL0, but
+ * nothing saves it for interrupts taken in the kernel, so IRQs stay masked
+ * until the matching call to `fpu_end`. Keep these sections short.
+ *
+ * Implementation is platform-dependent.
+ *
+ * @return state to pass to `fpu_end`
+ */
+extern "C" unsigned long fpu_begin();
+
+/**
+ * @brief Ends a section started by `fpu_begin`.
+ *
+ * @param state value returned by the matching call to `fpu_begin`
+ */
+extern "C" void fpu_end(unsigned long state);
+
+#endif
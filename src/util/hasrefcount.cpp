@@ -5,6 +5,10 @@ HasRefcount::HasRefcount()
 {
 }
 
+HasRefcount::~HasRefcount()
+{
+}
+
 int HasRefcount::getRefCount() const
 {
     return refcount;
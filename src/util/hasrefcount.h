@@ -6,6 +6,8 @@ class HasRefcount
 public:
     HasRefcount();
 
+    virtual ~HasRefcount();
+
     virtual int getRefCount() const;
 
     virtual void addReference();
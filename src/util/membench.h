@@ -0,0 +1,13 @@
+#ifndef _MEMBENCH_H
+#define _MEMBENCH_H
+
+/**
+ * @brief Times memcpy, memmove and memset over a range of sizes and logs
+ * their throughput in bytes per CPU cycle. Needs the kernel heap. Only
+ * built when the kernel is compiled with MEMBENCH=1.
+ *
+ * Implementation is platform-dependent.
+ */
+void membench();
+
+#endif
@@ -13,7 +13,16 @@
  */
 extern "C" void *memcpy(void *dest, const void *src, size_t count);
 
-extern "C" void memset(char *s, int size, int v);
+/**
+ * @brief Like memcpy, but the two regions may overlap.
+ * @see https://en.cppreference.com/w/c/string/byte/memmove
+ */
+extern "C" void *memmove(void *dest, const void *src, size_t count);
+
+/**
+ * @see https://en.cppreference.com/w/c/string/byte/memset
+ */
+extern "C" void *memset(void *s, int c, size_t count);
 
 extern "C" int strlen(const char *s);
 